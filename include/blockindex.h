@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __BLOCKINDEX_H__
+#define __BLOCKINDEX_H__
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <cstdint>
+#include "hash.h"
+
+typedef struct blockIndexHeader_t {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t blockSize;
+	uint64_t blocks;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+	int64_t ctimeSec;
+	int64_t ctimeNsec;
+	// plain SHA-256 of the file when indexed in HASH_FLAT mode, else empty
+	char flatSha256[SHA256_DIGEST_LENGTH * 2 + 1];
+} blockIndexHeader_t;
+
+/*
+ * Left next to the index by whoever rebuilt a file from the indexed one,
+ * followed by the byte ranges (offset, length) that may have changed.
+ */
+typedef struct blockHintHeader_t {
+	uint32_t magic;
+	uint32_t version;
+	// the file the index described and the file that was written from it,
+	// with its plain SHA-256
+	blockIndexHeader_t source;
+	blockIndexHeader_t target;
+	uint64_t ranges;
+} blockHintHeader_t;
+
+/*
+ * A persisted table of per-block SHA-256 digests of a file, used to find out
+ * which blocks changed since the last check.
+ *
+ * If the file identity (device, inode, size, mtime, ctime) still matches the
+ * index nothing is read at all. If it doesn't, but a hint says the file was
+ * rebuilt from the indexed one (see hint()), only the blocks the hint lists
+ * are hashed again. Otherwise every block is hashed again and compared
+ * against the index.
+ *
+ * With a HASH_FLAT engine the block digests come out of the same sequential
+ * read as the plain SHA-256 of the file, which is kept in the index too, so a
+ * changed file is read once and an unchanged one not at all.
+ *
+ * With verify set the file is read even when its identity matches, and any
+ * block that no longer agrees with the index is reported as changed.
+ */
+class BlockIndex {
+public:
+	explicit BlockIndex(std::string path = "");
+
+	bool enabled(void) const { return !indexPath.empty(); }
+	const std::string& path(void) const { return indexPath; }
+	bool lookup(const std::string& file, std::string& flatDigest);
+	bool update(const std::string& file, HashEngine& engine, std::atomic<size_t> *progress = NULL, bool verify = false);
+	bool hint(const std::string& source, const std::string& target, const std::string& targetSha256,
+		  const std::vector<std::pair<uint64_t, uint64_t>>& ranges) const;
+	bool root(std::string& digest) const;
+	bool flat(std::string& digest) const;
+
+	const std::vector<size_t>& changed(void) const { return changedBlocks; }
+	size_t rehashed(void) const { return numRehashed; }
+
+	static std::string ranges(const std::vector<size_t>& blocks, size_t maxLen);
+
+private:
+	bool load(void);
+	bool save(void);
+	bool loadHint(const blockIndexHeader_t& cur, size_t blockSize, std::vector<size_t>& dirty, std::string& flatDigest);
+
+	std::string indexPath;
+	blockIndexHeader_t header;
+	std::vector<unsigned char> digests;
+	std::vector<size_t> changedBlocks;
+	size_t numRehashed;
+};
+
+#endif /* __BLOCKINDEX_H__ */
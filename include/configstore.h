@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __CONFIGSTORE_H__
+#define __CONFIGSTORE_H__
+
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <egt/asio.hpp>
+#include "filewatch.h"
+
+/*
+ * The swupdate config flattened into one hash index. Every scalar is stored
+ * as text under its path, "suricatta/url" for a group member and
+ * "identify/serial/value" for a member of a list entry that has a name, so
+ * a lookup is a single hash probe instead of a walk over the libconfig tree.
+ *
+ * With watch() the file is reloaded when it is written or replaced. The new
+ * index only takes the place of the old one after the whole file parsed, a
+ * broken edit leaves the previous settings in effect.
+ */
+class ConfigStore {
+public:
+	typedef std::function<void(void)> Reloaded;
+
+	explicit ConfigStore(asio::io_context& io);
+
+	bool load(const std::string& file);
+	bool watch(Reloaded handler);
+
+	bool get(const std::string& node, const std::string& key, std::string& val) const;
+	bool get(const std::string& node, const std::string& key, int& val) const;
+	bool get(const std::string& node, const std::string& key, bool& val) const;
+	bool get(const std::string& node, const std::string& subnode, const std::string& key, std::string& val) const;
+
+	size_t size(void) const { return index.size(); }
+	size_t reloads(void) const { return numReloads; }
+
+private:
+	typedef std::unordered_map<std::string, std::string> index_t;
+
+	bool parse(const std::string& file, index_t& idx);
+	const std::string* lookup(const std::string& path) const;
+	void changed(void);
+
+	std::string cfgFile;
+	index_t index;
+
+	FileWatch watcher;
+	Reloaded reloadedHandler;
+	size_t numReloads;
+};
+
+#endif /* __CONFIGSTORE_H__ */
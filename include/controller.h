@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __CONTROLLER_H__
+#define __CONTROLLER_H__
+
+#include <string>
+#include <map>
+#include <functional>
+#include <sys/types.h>
+#include "http.h"
+#include "ubootenv.h"
+#include "ddi.h"
+#include "payload.h"
+
+#define DEFAULT_POLL_TIME 300   // 5 min
+
+/*
+ * The Hawkbit DDI side of the updater, without any UI: polls the controller
+ * base resource, reports the device attributes as configData (or as the
+ * feedback of an installed action) and keeps track of the update state
+ * stored in the u-boot env. Everything runs asynchronously on the HTTP
+ * session's event loop.
+ *
+ * The u-boot env is optional, without it the controller only tracks the
+ * state in memory, which is what the fleet simulator uses.
+ */
+class Controller {
+public:
+	typedef std::function<void(bool ok)> Completion;
+
+	Controller(HTTP& http, std::string uri, std::string sslkey, std::string sslcert, std::string id, UbootEnv *env = NULL);
+
+	void checkIfUpdated(void);
+	void confirmInstalled(void);
+	// with a slot, u-boot also switches to it in the same store
+	size_t markUpdateAvailable(const std::string& slot = "");
+
+	void checkIn(Completion done);
+	// done(false) right away while another poll is still in flight
+	void poll(Completion done);
+	bool handlePollResponse(std::string_view res);
+	void sendStatus(Completion done);
+
+	// a changed server, tenant or id starts over with a full poll and report
+	void server(std::string uri, std::string sslkey, std::string sslcert, std::string id);
+	void attribute(const std::string& name, const std::string& value) { payload.attribute(name, value); }
+
+	bool busy(void) const { return pollInFlight; }
+	ssize_t pollInterval(void) const { return serverPollTime; }
+	bool updateAvailable(void) const { return available; }
+	const std::string& deploymentBase(void) const { return deployment; }
+	ssize_t action(void) const { return actionId; }
+	// HTTP status and Retry-After of the last answer from the server
+	long status(void) const { return httpStatus; }
+	ssize_t retryAfter(void) const { return retryDelay; }
+	// polls answered with 304 or an unchanged body, status reports skipped
+	size_t unchanged(void) const { return numUnchanged; }
+	size_t skipped(void) const { return numSkipped; }
+	// times the status payload had to be serialized again
+	size_t payloadRebuilds(void) const { return payload.rebuilds(); }
+
+	const std::string& uri(void) const { return baseUri; }
+	const std::string& sslkey(void) const { return key; }
+	const std::string& sslcert(void) const { return cert; }
+
+private:
+	void response(long status);
+
+	HTTP& http;
+	UbootEnv *env;
+
+	std::string baseUri;
+	std::string key;
+	std::string cert;
+	std::string id;
+	std::string configUri;
+	StatusPayload payload;
+	size_t sentGeneration;
+	bool configRequested;
+	std::string lastPoll;
+
+	bool pollInFlight;
+	ssize_t serverPollTime;
+	std::string deployment;
+	ssize_t actionId;
+	bool available;
+	bool installed;
+	long httpStatus;
+	ssize_t retryDelay;
+	size_t numUnchanged;
+	size_t numSkipped;
+};
+
+#endif /* __CONTROLLER_H__ */
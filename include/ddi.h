@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DDI_H__
+#define __DDI_H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+/*
+ * Typed views of the Hawkbit DDI answers the updater uses. The parsers walk
+ * the JSON with SAX callbacks and only keep the fields listed here, no DOM is
+ * built, so a deployment with long chunk and artifact arrays costs no more
+ * than the artifacts it describes. Malformed or incomplete input is reported
+ * with an error code, never with an exception.
+ */
+
+typedef enum ddiError_t {
+	DDI_OK = 0,
+	DDI_ERR_SYNTAX,         // not JSON, or nested too deeply
+	DDI_ERR_MISSING,        // a required field is absent
+	DDI_ERR_VALUE,          // a field has the wrong type or format
+} ddiError_t;
+
+typedef struct artifact_t {
+	std::string filename;
+	std::string href;
+	std::string sha256;
+	size_t size;
+	// of a compressed artifact once unpacked, from the chunk metadata keys
+	// "<filename>.unpacked_sha256" and "<filename>.unpacked_size"
+	std::string unpackedSha256;
+	size_t unpackedSize;
+} artifact_t;
+
+// controller base resource, GET /<tenant>/controller/v1/<id>
+typedef struct ddiPoll_t {
+	ssize_t sleep;                  // s, -1 if the server sent none
+	std::string deploymentBase;
+	ssize_t actionId;               // -1 without a deploymentBase link
+	std::string cancelAction;
+	ssize_t cancelId;               // -1 without a cancelAction link
+	std::string configData;         // set while the server wants the attributes
+} ddiPoll_t;
+
+// deploymentBase/<action>
+typedef struct ddiDeployment_t {
+	ssize_t id;
+	std::string download;           // skip, attempt or forced
+	std::string update;
+	std::vector<artifact_t> artifacts;
+} ddiDeployment_t;
+
+ddiError_t ddiParsePoll(std::string_view body, ddiPoll_t& poll);
+ddiError_t ddiParseDeployment(std::string_view body, ddiDeployment_t& deployment);
+const char* ddiErrorString(ddiError_t err);
+
+#endif /* __DDI_H__ */
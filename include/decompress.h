@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DECOMPRESS_H__
+#define __DECOMPRESS_H__
+
+#include <string>
+#include <vector>
+#include <zstd.h>
+#include <lzma.h>
+#include <openssl/evp.h>
+#include "http.h"
+
+// largest back reference window accepted, in MiB; zstd --long and xz -9
+// need more than a 128 MB device can spare
+#define DECOMPRESS_WINDOW_MB 16
+// output is handed to the next sink in pieces of this size
+#define DECOMPRESS_OUT_SIZE (64 * 1024)
+
+typedef enum compression_t {
+	COMPRESSION_NONE = 0,
+	COMPRESSION_ZSTD,               // .zst
+	COMPRESSION_XZ,                 // .xz
+} compression_t;
+
+/*
+ * Unpacks a compressed artifact while it is received and hands the data on to
+ * the sink that stores it, so neither the compressed nor the unpacked image
+ * is ever held in memory or on flash as a whole.
+ *
+ * The compressed bytes are hashed here, the sink behind hashes the unpacked
+ * ones, so an artifact can be checked against the digest the server has for
+ * the file as well as against one of its content.
+ *
+ * Memory is bounded by the window size: frames or streams that need a larger
+ * window are rejected instead of allocated. xz streams made of several
+ * blocks (xz -T) are unpacked on spare cores; zstd frames can only be
+ * decoded sequentially and stay on the calling thread.
+ */
+class Decompressor : public HTTPSink {
+public:
+	Decompressor();
+	~Decompressor() noexcept;
+
+	static compression_t detect(const std::string& filename);
+	// the file name without the compression suffix
+	static std::string strip(const std::string& filename);
+	static const char* name(compression_t type);
+
+	// threads 0 for one less than there are cores
+	void limits(size_t windowMB, size_t threads);
+	bool open(compression_t type, HTTPSink *out);
+	bool start(long status) override;
+	bool write(const char *data, size_t size) override;
+	// flushes the decoder into the sink, so call it before finishing the
+	// sink; false if the data ended in the middle of a frame or stream,
+	// digest is over the compressed bytes
+	bool finish(std::string& digest);
+	void close(void);
+
+	size_t in(void) const { return numIn; }
+	size_t out(void) const { return numOut; }
+	// bytes the decoder holds, window included
+	size_t memory(void) const;
+
+private:
+	bool decodeZstd(const char *data, size_t size);
+	bool decodeXz(const char *data, size_t size, lzma_action action);
+	bool forward(size_t len);
+
+	compression_t type;
+	HTTPSink *sink;
+	ZSTD_DCtx *zstd;
+	lzma_stream xz;
+	bool xzOpen;
+	EVP_MD_CTX *mdCtx;
+	std::vector<char> outBuf;
+	size_t windowMB;
+	size_t threads;
+	size_t numIn;
+	size_t numOut;
+	bool ended;
+	bool failed;
+};
+
+#endif /* __DECOMPRESS_H__ */
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <openssl/sha.h>
+
+#define DELTA_SUFFIX ".egtdelta"
+#define DELTA_BLOCK_SIZE 4096
+#define DELTA_CHUNK_SIZE (1024 * 1024)
+
+typedef enum deltaOp_t {
+	DELTA_END = 0,
+	DELTA_COPY = 1,
+	DELTA_DATA = 2,
+} deltaOp_t;
+
+/*
+ * All fields are little endian. The digests are the plain SHA-256 of the
+ * images in hex, the source one is checked before anything is written. The
+ * header is followed by a list of
+ * operations, each a one byte deltaOp_t: DELTA_COPY is followed by the 64 bit
+ * source offset and length, DELTA_DATA by the 64 bit length and the literal
+ * bytes, DELTA_END closes the list.
+ */
+typedef struct __attribute__((packed)) deltaHeader_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t blockSize;
+	uint64_t sourceSize;
+	uint64_t targetSize;
+	char targetSha256[SHA256_DIGEST_LENGTH * 2];
+	char sourceSha256[SHA256_DIGEST_LENGTH * 2];
+} deltaHeader_t;
+
+/*
+ * Rebuilds a target image from the image already on the device and a delta
+ * in the rsync style format above. The delta is fed in arbitrary pieces as
+ * it is read, so neither of them is ever held in memory.
+ *
+ * The caller passes the SHA-256 of the source, which it usually knows from
+ * the digest cache or the block index. The target is only created once the
+ * header shows the delta was built against that exact image.
+ *
+ * changed() lists the byte ranges of the target that may differ from the
+ * source at the same offset, literal data and copies that moved, so the
+ * block index only has to rehash those.
+ */
+class DeltaPatcher {
+public:
+	DeltaPatcher();
+	~DeltaPatcher() noexcept;
+
+	bool open(const std::string& source, const std::string& target, const std::string& sourceSha256);
+	bool write(const char *data, size_t size);
+	bool finish(void);
+	void close(void);
+
+	bool apply(const std::string& delta, const std::string& source, const std::string& target, const std::string& sourceSha256);
+
+	std::string targetSha256(void) const;
+	size_t copied(void) const { return numCopied; }
+	size_t literal(void) const { return numLiteral; }
+	const std::vector<std::pair<uint64_t, uint64_t>>& changed(void) const { return changedRanges; }
+
+private:
+	bool parseHeader(void);
+	void mark(uint64_t offset, uint64_t length);
+	bool copy(uint64_t offset, uint64_t length);
+	bool output(const char *data, size_t size);
+
+	int srcFd;
+	int dstFd;
+	std::string targetPath;
+	std::string sourceDigest;
+	deltaHeader_t header;
+	bool haveHeader;
+	bool done;
+	bool failed;
+
+	// bytes of a header or op that arrived split across writes
+	std::vector<char> pending;
+	uint64_t literalLeft;
+	uint64_t dstOffset;
+	std::vector<char> copyBuf;
+
+	size_t numCopied;
+	size_t numLiteral;
+	std::vector<std::pair<uint64_t, uint64_t>> changedRanges;
+};
+
+/*
+ * Builds a delta between two local images: the source is indexed by block
+ * with a rolling weak checksum, the target is scanned byte by byte and every
+ * block that also exists in the source becomes a copy instead of literal data.
+ */
+class DeltaBuilder {
+public:
+	explicit DeltaBuilder(size_t blockSize = DELTA_BLOCK_SIZE);
+
+	bool build(const std::string& source, const std::string& target, const std::string& delta);
+
+	size_t copied(void) const { return numCopied; }
+	size_t literal(void) const { return numLiteral; }
+	size_t deltaSize(void) const { return numDelta; }
+	const std::string& sourceSha256(void) const { return sourceDigest; }
+
+private:
+	size_t blkSize;
+	std::string sourceDigest;
+	size_t numCopied;
+	size_t numLiteral;
+	size_t numDelta;
+};
+
+#endif /* __DELTA_H__ */
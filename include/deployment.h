@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DEPLOYMENT_H__
+#define __DEPLOYMENT_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <openssl/sha.h>
+#include "http.h"
+#include "ddi.h"
+#include "installer.h"
+#include "decompress.h"
+
+#define JOURNAL_INTERVAL (4 * 1024 * 1024)
+#define DOWNLOAD_RETRIES 3
+
+// received data is written and hashed in chunks that take about this long
+#define SINK_CHUNK_BUDGET_US 2000
+#define SINK_CHUNK_MIN (16 * 1024)
+#define SINK_CHUNK_MAX (1024 * 1024)
+
+/*
+ * Hashes and stores a download as it is received, so the artifact is never
+ * held in memory and never has to be read back from flash to be verified.
+ *
+ * Every JOURNAL_INTERVAL bytes the data is synced and a journal with the
+ * offset and the partial SHA-256 state is written next to the file. open()
+ * picks the journal up again, so an interrupted download resumes with a Range
+ * request from the last checkpoint instead of starting over. The sync runs on
+ * a worker thread, so slow flash doesn't hold up the event loop; while one is
+ * still in progress the next checkpoint waits for a later write.
+ *
+ * The sink runs on the event loop, so data is collected and written and
+ * hashed in chunks sized to take about SINK_CHUNK_BUDGET_US each. On a fast
+ * system that means few large writes, on a loaded one short stalls that
+ * leave the loop free for the application in between.
+ */
+class DigestSink : public HTTPSink {
+public:
+	DigestSink();
+	~DigestSink() noexcept;
+
+	bool open(const std::string& path, const std::string& expected, bool resume = true);
+	bool start(long status) override;
+	bool write(const char *data, size_t size) override;
+	bool checkpoint(void);
+	bool finish(std::string& digest);
+	void close(void);
+	void discard(void);
+
+	size_t offset(void) const { return resumeOffset; }
+	size_t chunk(void) const { return chunkSize; }
+	size_t written(void) const { return numWritten; }
+	size_t received(void) const { return numReceived; }
+
+private:
+	bool loadJournal(void);
+	bool reset(void);
+	bool flush(void);
+	bool checkpointAsync(void);
+	void waitJournal(void);
+
+	std::string filePath;
+	std::string journalPath;
+	std::string expected;
+	int fd;
+	SHA256_CTX mdCtx;
+	bool failed;
+	size_t numWritten;
+	size_t numReceived;
+	size_t resumeOffset;
+	size_t lastCheckpoint;
+	std::string pending;
+	size_t chunkSize;
+
+	std::thread journalWorker;
+	std::atomic<bool> journalBusy;
+	std::atomic<bool> journalFailed;
+};
+
+/*
+ * Follows the deploymentBase link of a Hawkbit action, downloads every
+ * artifact of every chunk through the HTTP session and checks it against the
+ * SHA-256 reported by the server.
+ *
+ * Once install() named a slot, INSTALL_SUFFIX artifacts go through the slot
+ * writer straight into that device instead of the download directory.
+ *
+ * Artifacts ending in .zst or .xz are unpacked on the way and stored without
+ * the suffix. The server's SHA-256 is checked against the compressed bytes,
+ * an unpackedSha256 from the chunk metadata against the unpacked ones.
+ */
+class DeploymentFetcher {
+public:
+	typedef std::function<void(bool ok)> Completion;
+
+	DeploymentFetcher(HTTP& http, std::string downloadDir);
+
+	void fetch(const std::string& deploymentBase, const std::string& sslkey, const std::string& sslcert, Completion done);
+	void install(SlotWriter *writer, const std::string& device) { slotWriter = writer; slotDevice = device; }
+	void decompression(size_t windowMB, size_t threads) { unpack.limits(windowMB, threads); }
+
+	bool busy(void) const { return inProgress; }
+	const std::vector<artifact_t>& artifacts(void) const { return artifactList; }
+	std::string path(const artifact_t& artifact) const;
+	// a slot artifact of the last deployment was written and read back
+	bool installed(void) const { return slotInstalled; }
+
+private:
+	bool parseDeployment(std::string_view res);
+	void fetchNext(void);
+	void download(void);
+	void installSlot(void);
+	bool check(const artifact_t& artifact, const std::string& packed, const std::string& unpacked);
+	void complete(bool ok);
+
+	HTTP& http;
+	std::string downloadDir;
+	std::string sslkey;
+	std::string sslcert;
+
+	std::vector<artifact_t> artifactList;
+	size_t next;
+	size_t attempts;
+	DigestSink sink;
+	Decompressor unpack;
+	SlotWriter *slotWriter;
+	std::string slotDevice;
+	bool slotInstalled;
+	Completion done;
+	bool inProgress;
+};
+
+#endif /* __DEPLOYMENT_H__ */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DIGESTCACHE_H__
+#define __DIGESTCACHE_H__
+
+#include <string>
+#include <cstdint>
+
+#define DIGEST_CACHE_SAMPLE_SIZE 4096
+
+typedef struct fileIdentity_t {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+	int64_t ctimeSec;
+	int64_t ctimeNsec;
+	std::string sample;
+} fileIdentity_t;
+
+/*
+ * Remembers the digest of a file together with its identity (device, inode,
+ * size, mtime and ctime, plus optionally a fingerprint of a few sampled
+ * blocks), so an unchanged file does not have to be hashed again on the next
+ * boot. The tag ties an entry to the way the digest was computed (hash mode,
+ * block size, dm-verity root, ...), a different tag is a miss.
+ *
+ * store() takes the identity taken before hashing and refuses to cache the
+ * digest if the file changed while it was being hashed.
+ */
+class DigestCache {
+public:
+	explicit DigestCache(std::string path = "", bool sample = true);
+
+	bool identify(const std::string& file, fileIdentity_t& id);
+	bool lookup(const std::string& file, const std::string& tag, std::string& digest);
+	bool store(const std::string& file, const std::string& tag, const fileIdentity_t& id, const std::string& digest);
+
+private:
+	std::string entry(const std::string& file, const std::string& tag, const fileIdentity_t& id);
+
+	std::string cachePath;
+	bool sampleBlocks;
+};
+
+#endif /* __DIGESTCACHE_H__ */
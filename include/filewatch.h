@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __FILEWATCH_H__
+#define __FILEWATCH_H__
+
+#include <string>
+#include <map>
+#include <set>
+#include <memory>
+#include <functional>
+#include <egt/asio.hpp>
+
+// editors and provisioning scripts write a file in several steps
+#define FILEWATCH_SETTLE_MS 200
+
+/*
+ * Tells the event loop when one of a set of files is created, written or
+ * replaced, using inotify instead of polling with stat. The directories are
+ * watched rather than the files, so files that don't exist yet and files
+ * that are replaced by a rename are seen as well. Bursts of events are
+ * folded into one call of the handler once the files settled.
+ *
+ * A directory that doesn't exist yet can't be watched. Its nearest existing
+ * parent is watched instead, and the watch moves down as the missing
+ * directories are created.
+ */
+class FileWatch {
+public:
+	typedef std::function<void(void)> Changed;
+
+	explicit FileWatch(asio::io_context& io);
+	~FileWatch();
+
+	void onChanged(Changed handler) { changedHandler = handler; }
+	bool add(const std::string& file);
+	void clear(void);
+
+	bool watching(void) const { return (files.empty() != true) || (pending.empty() != true); }
+
+private:
+	bool watch(const std::string& file);
+	void wait(void);
+
+	asio::io_context& io;
+	std::unique_ptr<asio::posix::stream_descriptor> events;
+	asio::steady_timer settle;
+	std::map<int, std::string> dirs;
+	std::set<std::string> files;
+	// files whose directory is still missing
+	std::set<std::string> pending;
+	Changed changedHandler;
+};
+
+#endif /* __FILEWATCH_H__ */
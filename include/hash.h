@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <openssl/sha.h>
+
+#define HASH_BLOCK_SIZE (1024 * 1024)
+#define HASH_BLOCK_ALIGN 4096
+
+typedef enum hashMode_t {
+	HASH_FLAT = 0,
+	HASH_TREE,
+} hashMode_t;
+
+/*
+ * Hashes a file with large, page aligned reads and kernel readahead.
+ *
+ * HASH_FLAT is a plain SHA-256 over the whole file, read sequentially.
+ * HASH_TREE splits the file into blockSize blocks, hashes the blocks on
+ * several worker threads and returns the SHA-256 of the concatenated block
+ * digests. Both sides have to agree on the block size for tree digests to
+ * be comparable.
+ *
+ * hashBlocks() rehashes only the listed blocks into a table of per-block
+ * digests, which treeRoot() turns into the same root as HASH_TREE.
+ * hashFileBlocks() fills that table for every block during the sequential
+ * read of HASH_FLAT, so both come from a single pass over the file.
+ *
+ * If a progress counter is passed, the number of bytes hashed so far is added
+ * to it as the work proceeds, so another thread can report progress.
+ */
+class HashEngine {
+public:
+	explicit HashEngine(hashMode_t mode = HASH_FLAT, size_t blockSize = HASH_BLOCK_SIZE, size_t threads = 0);
+
+	bool hashFile(const std::string& file, std::string& digest, std::atomic<size_t> *progress = NULL);
+	bool hashBlocks(const std::string& file, const std::vector<size_t>& blocks, std::vector<unsigned char>& digests, std::atomic<size_t> *progress = NULL);
+	bool hashFileBlocks(const std::string& file, std::string& digest, std::vector<unsigned char>& digests, std::atomic<size_t> *progress = NULL);
+
+	hashMode_t mode(void) const { return hashMode; }
+	size_t blockSize(void) const { return blkSize; }
+	size_t threads(void) const { return numThreads; }
+
+	size_t bytes(void) const { return numBytes; }
+	double seconds(void) const { return elapsed; }
+	double throughput(void) const;
+
+	static bool parseMode(const std::string& name, hashMode_t& mode);
+	static std::string modeName(hashMode_t mode);
+	static std::string toHex(const unsigned char *md, size_t len);
+	static bool treeRoot(const std::vector<unsigned char>& digests, unsigned char *md);
+
+private:
+	bool hashFlat(int fd, size_t size, unsigned char *md, std::atomic<size_t> *progress, unsigned char *digests = NULL);
+	bool hashTree(int fd, size_t size, unsigned char *md, std::atomic<size_t> *progress);
+	bool hashBlock(int fd, size_t block, size_t size, unsigned char *buf, unsigned char *md);
+	bool hashBlockList(int fd, size_t size, const std::vector<size_t>& list, unsigned char *digests, std::atomic<size_t> *progress);
+
+	hashMode_t hashMode;
+	size_t blkSize;
+	size_t numThreads;
+
+	size_t numBytes;
+	double elapsed;
+};
+
+#endif /* __HASH_H__ */
@@ -2,26 +2,199 @@
 #define __HTTP_H__
 
 #include <string>
+#include <string_view>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
 #include <curl/curl.h>
+#include <egt/asio.hpp>
+
+// keep at most this much buffer capacity between requests
+#define HTTP_BUFFER_KEEP (64 * 1024)
 
 typedef struct writeData {
         const char *pData;
         size_t remaining;
 } writeData;
 
+/*
+ * Receives a response body chunk by chunk as it arrives instead of having it
+ * buffered in memory. start() is called with the HTTP status before the first
+ * chunk, so a sink that asked for a range can tell whether the server honoured
+ * it. Returning false from either aborts the transfer.
+ */
+class HTTPSink {
+public:
+        virtual ~HTTPSink() = default;
+
+        virtual bool start(long status) { return true; }
+        virtual bool write(const char *data, size_t size) = 0;
+};
+
+// cache validators of a response, sent back on the next conditional GET
+typedef struct validatorData {
+        std::string etag;
+        std::string lastModified;
+} validatorData;
+
+/*
+ * Response bodies that are handed to the completion are collected in one
+ * contiguous buffer owned by the session. It is sized from Content-Length
+ * when the first chunk arrives and reused by the next request, so a poll
+ * answer is written once and parsed in place.
+ */
+typedef struct bufferData {
+        std::string body;
+        CURL *curl;
+        bool sized;
+        size_t allocations;
+        size_t copied;
+} bufferData;
+
+typedef struct sinkData {
+        HTTPSink *sink;
+        CURL *curl;
+        bool started;
+} sinkData;
+
+/*
+ * Drives a curl multi handle from an asio io_context: curl's sockets are
+ * watched with stream descriptors and its timeout with a steady timer, so
+ * transfers progress from the event loop without ever blocking it.
+ */
+class HTTPMulti {
+public:
+        explicit HTTPMulti(asio::io_context& io);
+        ~HTTPMulti() noexcept;
+
+        bool add(CURL *easy, std::function<void(CURLcode)> done);
+        void remove(CURL *easy);
+
+private:
+        struct SocketWatch;
+
+        static int socketCb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp);
+        static int timerCb(CURLM *multi, long timeoutMs, void *userp);
+
+        void arm(std::shared_ptr<SocketWatch> watch);
+        void socketAction(curl_socket_t s, int action);
+        void checkDone(void);
+
+        asio::io_context& ioCtx;
+        asio::steady_timer timer;
+        CURLM *multi;
+        int running;
+        std::map<curl_socket_t, std::shared_ptr<SocketWatch>> sockets;
+        std::map<CURL*, std::function<void(CURLcode)>> transfers;
+};
+
+/*
+ * A long-lived HTTP session. The easy handle is kept for the lifetime of the
+ * object and attached to a share handle holding the DNS cache, TLS session
+ * cache and connection pool, so consecutive requests to the same server reuse
+ * one keep-alive connection instead of doing a full (m)TLS handshake each time.
+ *
+ * The overloads taking a completion callback are asynchronous and require the
+ * session to be bound to an HTTPMulti. They are queued and run one after the
+ * other on the same handle; the callback is invoked from the event loop.
+ * Blocking and asynchronous requests must not be mixed while one is in flight.
+ */
 class HTTP {
 public:
-        HTTP();
+        // body points into the session's buffer and is only valid until the
+        // completion returns, large bodies should go to an HTTPSink instead
+        typedef std::function<void(bool ok, long status, std::string_view body)> Completion;
+
+        explicit HTTP(HTTPMulti *multi = NULL);
         ~HTTP() noexcept;
 
         std::string get(const std::string& uri, const std::string& sslkey, const std::string& sslcert);
         bool post(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size);
         bool put(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size);
 
+        // a conditional GET sends the validators of the last 200 answer for
+        // the same URI and completes with status 304 and no body when the
+        // resource is unchanged
+        void get(const std::string& uri, const std::string& sslkey, const std::string& sslcert, Completion done, bool conditional = false);
+        void invalidate(const std::string& uri) { validators.erase(uri); }
+        void post(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size, Completion done);
+        void put(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size, Completion done);
+        void download(const std::string& uri, const std::string& sslkey, const std::string& sslcert, HTTPSink *sink, Completion done, curl_off_t offset = 0);
+
+        // applies to downloads into a sink, 0 for unlimited
+        void recvLimit(curl_off_t bytesPerSecond) { recvSpeed = bytesPerSecond; }
+        // stops reading a running or the next download until every pause
+        // is matched by a resume
+        void pauseDownload(bool pause);
+
+        bool busy(void) const { return inFlight; }
+        size_t requests(void) const { return numRequests; }
+        size_t handshakesAvoided(void) const { return numReused; }
+        size_t connects(void) const { return numConnects; }
+        size_t bytesSent(void) const { return numSent; }
+        size_t bytesReceived(void) const { return numReceived; }
+        // seconds from the Retry-After header of the last response, 0 if none
+        curl_off_t retryAfter(void) const { return lastRetryAfter; }
+        size_t notModified(void) const { return numNotModified; }
+        // response buffer (re)allocations and bytes written into it
+        size_t bufferAllocations(void) const { return response.allocations; }
+        size_t bytesBuffered(void) const { return response.copied; }
+
 private:
-         CURL *curl;
-         void *putData;
-         ssize_t putSize;
+        typedef enum method_t {
+                METHOD_GET = 0,
+                METHOD_POST,
+                METHOD_PUT,
+        } method_t;
+
+        typedef struct request_t {
+                method_t method;
+                std::string uri;
+                std::string sslkey;
+                std::string sslcert;
+                std::string body;
+                Completion done;
+                HTTPSink *sink;
+                curl_off_t offset;
+                bool conditional;
+        } request_t;
+
+        void setupRequest(const std::string& uri, const std::string& sslkey, const std::string& sslcert);
+        void setupBody(method_t method, const char *data, ssize_t size);
+        void setupConditional(const std::string& uri);
+        void setupBuffer(void);
+        void updateValidators(const std::string& uri, long status);
+        bool finishRequest(CURLcode res);
+        void recordPhases(long connects);
+        bool perform(void);
+
+        void enqueue(request_t req);
+        void startNext(void);
+
+        CURL *curl;
+        CURLSH *share;
+        struct curl_slist *headers;
+        writeData upload;
+        sinkData receive;
+
+        HTTPMulti *multi;
+        std::deque<request_t> queue;
+        request_t current;
+        bufferData response;
+        bool inFlight;
+        std::map<std::string, validatorData> validators;
+        validatorData received;
+
+        size_t numRequests;
+        size_t numReused;
+        size_t numConnects;
+        size_t numSent;
+        size_t numReceived;
+        curl_off_t lastRetryAfter;
+        size_t numNotModified;
+        curl_off_t recvSpeed;
+        size_t downloadPauses;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __INSTALLER_H__
+#define __INSTALLER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <openssl/evp.h>
+#include <egt/asio.hpp>
+#include "http.h"
+
+// artifacts streamed into the inactive slot instead of the download directory
+#define INSTALL_SUFFIX ".rootfs"
+#define INSTALL_BUFFER_SIZE (1024 * 1024)
+#define INSTALL_BUFFERS 4
+// received data held back while waiting for the writer, more is written
+// out with the event loop waiting
+#define INSTALL_OVERFLOW_MAX (256 * 1024)
+// O_DIRECT wants buffers, lengths and offsets aligned to the logical block
+#define INSTALL_ALIGN 4096
+
+/*
+ * Streams an artifact straight into a partition or UBI volume of the
+ * inactive A/B slot while it is downloaded.
+ *
+ * Receiving, hashing and writing overlap in a pipeline of three stages
+ * sharing INSTALL_BUFFERS aligned buffers: the event loop copies received
+ * data into a free buffer, a hash thread digests full buffers in order and a
+ * write thread stores them with O_DIRECT, or as a UBI volume update. When
+ * all buffers are in flight the download is paused until the writer hands
+ * one back, so memory stays bounded and the install takes about as long as
+ * the slowest stage instead of the sum of all three.
+ *
+ * The device is synced once at the end and read back, uncached, to check
+ * that what is on flash has the digest of what was received. Only then is
+ * the slot reported as installed.
+ */
+class SlotWriter : public HTTPSink {
+public:
+	typedef std::function<void(bool ok, std::string digest)> Completion;
+	// the download has to stop (true) or may continue (false)
+	typedef std::function<void(bool pause)> Backpressure;
+
+	explicit SlotWriter(asio::io_context& io);
+	~SlotWriter() noexcept;
+
+	bool open(const std::string& device, size_t size, Backpressure backpressure);
+	bool start(long status) override;
+	bool write(const char *data, size_t size) override;
+	// hands what was held back while the download was paused on to the
+	// pipeline, waiting for buffers; only once the transfer has ended
+	bool flush(void);
+	// flushes and drains the pipeline, syncs and reads the slot back
+	void finish(Completion done);
+	void abort(void);
+
+	void readback(bool enable) { verifyReadback = enable; }
+	bool busy(void) const { return running; }
+	size_t written(void) const { return numWritten; }
+	// times the download had to wait for the writer
+	size_t stalls(void) const { return numStalls; }
+
+	// the slot device the running system was booted from
+	static bool active(const std::string& device);
+
+private:
+	typedef struct buffer_t {
+		unsigned char *data;
+		size_t len;
+	} buffer_t;
+
+	void hasher(void);
+	void writer(void);
+	bool store(const buffer_t& buf);
+	bool complete(std::string& digest);
+	bool verify(const std::string& digest);
+	bool push(const char *data, size_t len, bool block);
+	bool take(bool block);
+	void refill(void);
+	void stop(void);
+	void release(void);
+
+	asio::io_context& io;
+	std::string device;
+	size_t size;
+	int fd;
+	bool ubi;
+	bool direct;
+	bool verifyReadback;
+	Backpressure backpressure;
+	Completion done;
+
+	std::vector<buffer_t> buffers;
+	size_t filling;
+	std::string overflow;
+	bool paused;
+	bool running;
+	std::atomic<bool> failed;
+	size_t numReceived;
+	std::atomic<size_t> numWritten;
+	size_t numStalls;
+
+	// buffer indices moving from stage to stage, all under lock
+	std::mutex lock;
+	std::condition_variable hashReady;
+	std::condition_variable writeReady;
+	std::condition_variable bufferFreed;
+	std::deque<size_t> freeList;
+	std::deque<size_t> hashQueue;
+	std::deque<size_t> writeQueue;
+	bool waiting;
+	bool draining;
+	bool hashDone;
+	bool cancelled;
+
+	EVP_MD_CTX *mdCtx;
+	std::thread hashThread;
+	std::thread writeThread;
+};
+
+#endif /* __INSTALLER_H__ */
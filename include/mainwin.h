@@ -9,39 +9,14 @@
 
 #include <egt/ui>
 #include <egt/window.h>
-#include "version.h"
-#include "libconfig.h++"
-#include "libuboot.h"
+#include "updater.h"
+#include "statusbar.h"
+#include "metrics.h"
 
 using namespace std;
 using namespace egt;
 using namespace egt::experimental;
 
-static const std::string EGT_SWUPDATE_VERSION = std::to_string(EGT_SWUPDATE_VERSION_MAJOR) + "." + std::to_string(EGT_SWUPDATE_VERSION_MINOR) + "." + std::to_string(EGT_SWUPDATE_VERSION_PATCH);
-inline static const std::vector<std::string> ubootEnvVars = {"upgrade_available", "bootcount", "ustate"};
-inline static const std::vector<std::string> ustateVal = {"0", "1", "2", "3", "4", "5", "6", "7"};
-
-#define HASH_CHUNK_SIZE 4096
-
-typedef enum ubootEnvVars_t {
-	ENV_UPGRADE = 0,
-	ENV_BOOTCNT,
-	ENV_USTATE,
-	ENV_MAX,
-} ubootEnvVars_t;
-
-typedef enum ustate_t {
-	STATE_OK = 0,
-	STATE_INSTALLED = 1,
-	STATE_TESTING = 2,
-	STATE_FAILED = 3,
-	STATE_NOT_AVAILABLE = 4,
-	STATE_ERROR = 5,
-	STATE_WAIT = 6,
-	STATE_IN_PROGRESS = 7,
-	STATE_LAST = STATE_IN_PROGRESS
-} ustate_t;
-
 class RebootWindow : public egt::Popup {
 public:
 	explicit RebootWindow() : egt::Popup(egt::Application::instance().screen()->size() / 2) {
@@ -99,6 +74,84 @@ private:
 
 };
 
+// the recorded latencies, refreshed while the popup is open
+class DiagnosticsWindow : public egt::Popup {
+public:
+	explicit DiagnosticsWindow() : egt::Popup(egt::Application::instance().screen()->size() / 2) {
+		const std::vector<std::pair<std::string, std::string>> metrics = {
+			{"Check-in", "egt_swupdate_checkin_seconds"},
+			{"DNS", "egt_swupdate_http_dns_seconds"},
+			{"Connect", "egt_swupdate_http_connect_seconds"},
+			{"TLS", "egt_swupdate_http_tls_seconds"},
+			{"First byte", "egt_swupdate_http_ttfb_seconds"},
+			{"Transfer", "egt_swupdate_http_transfer_seconds"},
+			{"HTTP errors", "egt_swupdate_http_errors_total"},
+			{"App data hash", "egt_swupdate_app_data_hash_seconds"},
+			{"Env store", "egt_swupdate_env_store_seconds"},
+		};
+
+		auto sizer = make_shared<VerticalBoxSizer>();
+		add(expand(sizer));
+
+		for (const auto& m : metrics) {
+			auto row = make_shared<Label>(m.first + ": -", AlignFlag::left);
+			row->align(AlignFlag::left | AlignFlag::top);
+			row->margin(5);
+			sizer->add(row);
+			rows.push_back({m.first, m.second, row});
+		}
+
+		hashRate = make_shared<Label>("Hash throughput: -", AlignFlag::left);
+		hashRate->align(AlignFlag::left | AlignFlag::top);
+		hashRate->margin(5);
+		sizer->add(hashRate);
+
+		close = Button("Close");
+		close.align(egt::AlignFlag::right | egt::AlignFlag::bottom);
+		add(close);
+
+		close.on_click([this](egt::Event&) {
+			refreshTimer.stop();
+			this->hide();
+		});
+
+		refreshTimer = PeriodicTimer(std::chrono::seconds(1));
+		refreshTimer.on_timeout([this]() {
+			refresh();
+		});
+	}
+
+	void open(void) {
+		refresh();
+		refreshTimer.start();
+		show_modal(true);
+	}
+
+protected:
+	typedef struct row_t {
+		std::string title;
+		std::string metric;
+		std::shared_ptr<Label> label;
+	} row_t;
+
+	void refresh(void) {
+		double rate;
+
+		for (auto& row : rows) {
+			row.label->text(row.title + ": " + Metrics::instance().summary(row.metric));
+		}
+
+		if (Metrics::instance().value("egt_swupdate_app_data_hash_bytes_per_second", rate) == true) {
+			hashRate->text("Hash throughput: " + std::to_string((int) (rate / (1024 * 1024))) + " MB/s");
+		}
+	}
+
+	std::vector<row_t> rows;
+	std::shared_ptr<Label> hashRate;
+	Button close;
+	PeriodicTimer refreshTimer;
+};
+
 class MainWindow : public TopWindow {
 public:
 	MainWindow(std::string const cfg);
@@ -108,48 +161,15 @@ private:
 	std::string getTime(void);
 	std::string getTime(ssize_t future);
 
-	bool readConfigFile(std::string cfgFile);
-	bool getAttrFromCfg(std::string node, std::string attr, std::string& val);
-	bool getAttrFromCfg(std::string node, std::string subnode, std::string key, std::string& val);
-	void getServerAttrs(void);
-
-	size_t initUbootEnvAccess(void);
-	size_t setUbootEnvVar(ubootEnvVars_t var, std::string val);
-	size_t writeUbootVarToEnv(ubootEnvVars_t var, std::string val);
-	size_t setUpdateAvailableInUbootEnv(void);
-	void checkIfUpdated(void);
-	bool hashAppData(std::string file, std::string& digest);
-	bool pollHawkbitServer(void);
-	bool sendMsgToHawkbitServer(void);
-
-	PeriodicTimer cpuTimer;
-	CPUMonitorUsage cpuMon;
-	std::shared_ptr<Label> timeClock;
-	std::shared_ptr<Label> cpuMonLabel;
+	std::shared_ptr<StatusBar> header;
 	std::shared_ptr<Label> pollTime;
 
-	libconfig::Config swupdateCfg;
-
-	bool provisioned;
-
-	struct uboot_ctx *ubootCtx;
-	ssize_t ustate;
-	bool writeUbootEnv = false;
-
-	PeriodicTimer updatePollTimer;
-	ssize_t serverPollTime;
-	ssize_t actionId;
-	bool updateAvailable;
-	bool updateInstalled;
-
-	std::string uri;
-	std::string sslkey;
-	std::string sslcert;
-
-	std::string appDataFile;
-	std::string appDataMd;
+	Updater updater;
+	PeriodicTimer hashProgressTimer;
+	std::shared_ptr<Label> appHash;
 
 	RebootWindow rebootWin;
+	DiagnosticsWindow diagWin;
 };
 
 #endif /* __MAINWIN_H__ */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+/*
+ * Latency histograms, counters and gauges of the update agent, in the
+ * Prometheus text format. Durations are observed in seconds into fixed
+ * buckets, so recording is a bucket search and two additions and memory
+ * does not grow with the number of observations. The registry is shared by
+ * the event loop and the hash worker, every access takes its lock.
+ *
+ * The names follow the Prometheus conventions, the text file written by
+ * writeTextfile() is meant for the node exporter's textfile collector.
+ */
+class Histogram {
+public:
+	Histogram();
+
+	void observe(double value);
+	// estimated from the buckets, like histogram_quantile()
+	double quantile(double q) const;
+
+	const std::vector<double>& bounds(void) const { return upper; }
+	const std::vector<size_t>& buckets(void) const { return counts; }
+	size_t count(void) const { return total; }
+	double sum(void) const { return valueSum; }
+
+private:
+	std::vector<double> upper;
+	std::vector<size_t> counts;
+	size_t total;
+	double valueSum;
+};
+
+class Metrics {
+public:
+	static Metrics& instance(void);
+
+	void observe(const std::string& name, double seconds);
+	void add(const std::string& name, double value = 1);
+	void set(const std::string& name, double value);
+
+	std::string prometheus(void);
+	bool writeTextfile(const std::string& file);
+
+	// "n 12, p50 3.1 ms, p95 8.0 ms" for a histogram, the value otherwise
+	std::string summary(const std::string& name);
+	// counters and gauges
+	bool value(const std::string& name, double& v);
+
+private:
+	Metrics() {}
+
+	std::mutex lock;
+	std::map<std::string, Histogram> histograms;
+	std::map<std::string, double> counters;
+	std::map<std::string, double> gauges;
+};
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __PAYLOAD_H__
+#define __PAYLOAD_H__
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <ctime>
+
+/*
+ * The JSON body of the configData and feedback requests. The document is
+ * serialized once and kept in a buffer, the time and the result have fixed
+ * width slots in it that are overwritten for every send. It is only
+ * serialized again after an attribute changed, so a steady state check-in
+ * doesn't allocate or format anything but the timestamp.
+ */
+class StatusPayload {
+public:
+	StatusPayload();
+
+	void id(const std::string& id);
+	void attribute(const std::string& name, const std::string& value);
+
+	// result is "success", "failure" or "none"
+	std::string_view build(std::time_t now, const char *result = "success");
+
+	// changes whenever the attributes do
+	size_t generation(void) const { return attrGeneration; }
+	size_t rebuilds(void) const { return numRebuilds; }
+
+private:
+	void rebuild(void);
+
+	std::string devId;
+	std::map<std::string, std::string> attrs;
+	std::string buffer;
+	size_t timePos;
+	size_t resultPos;
+	bool dirty;
+	size_t attrGeneration;
+	size_t numRebuilds;
+};
+
+#endif /* __PAYLOAD_H__ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __POLLSCHEDULER_H__
+#define __POLLSCHEDULER_H__
+
+#include <random>
+#include <chrono>
+#include <functional>
+#include <sys/types.h>
+#include <egt/asio.hpp>
+
+#define POLL_JITTER 10          // percent of the interval
+#define POLL_RETRY_MIN 30       // s, first retry after a failed check-in
+#define POLL_RETRY_MAX 3600     // s
+#define POLL_FAST 15            // s, while a deployment is in progress
+#define POLL_START_SPREAD 10    // s
+
+typedef struct pollSettings_t {
+	ssize_t jitter;
+	ssize_t retryMin;
+	ssize_t retryMax;
+	ssize_t fastInterval;
+	ssize_t startSpread;
+} pollSettings_t;
+
+/*
+ * Decides when the next check-in happens. After every check-in the timer is
+ * re-armed with the interval the server asked for, spread by a random
+ * jitter so a fleet that booted together drifts apart instead of polling in
+ * lock step. Failed check-ins are retried with a randomized exponential
+ * backoff that also honours Retry-After on 429 and 503 answers, and while a
+ * deployment is in progress the interval is shortened.
+ *
+ * Only one check-in runs at a time, asking for one while another is running
+ * queues a single immediate follow-up.
+ */
+class PollScheduler {
+public:
+	typedef std::function<void(bool ok, long status, ssize_t retryAfter)> Result;
+	typedef std::function<void(Result done)> Poll;
+
+	PollScheduler(asio::io_context& io, Poll poll);
+
+	static pollSettings_t defaults(void);
+	void settings(const pollSettings_t& s) { config = s; }
+
+	void start(void);
+	void stop(void);
+	void now(void);
+
+	void interval(ssize_t seconds) { serverInterval = seconds; }
+	void fast(bool enable) { fastMode = enable; }
+
+	// seconds until the next check-in, 0 while one is running
+	ssize_t next(void) const;
+	size_t failures(void) const { return failed; }
+
+private:
+	void arm(double seconds);
+	void fire(void);
+	void finished(bool ok, long status, ssize_t retryAfter);
+	double uniform(double from, double to);
+
+	asio::steady_timer timer;
+	Poll poll;
+	pollSettings_t config;
+	std::minstd_rand rng;
+
+	ssize_t serverInterval;
+	bool fastMode;
+	bool running;
+	bool pending;
+	size_t failed;
+	std::chrono::steady_clock::time_point due;
+};
+
+#endif /* __POLLSCHEDULER_H__ */
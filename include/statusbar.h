@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __STATUSBAR_H__
+#define __STATUSBAR_H__
+
+#include <string>
+#include <ctime>
+#include <egt/ui>
+
+/*
+ * The header of the main window: app name with the provisioning icon, the
+ * clock and the CPU load. It refreshes once a second. Each label keeps the
+ * text it shows and is only given new text when the string differs, because
+ * every text() call damages and re-rasterizes the label over the blended
+ * background. The date and the time of day are separate labels so the
+ * per-second redraw covers only "hh:mm:ss". The labels that change often
+ * have a fixed size, so a new value never relayouts the header.
+ *
+ * Under the system CPU load a small label shows the CPU time this process
+ * used per second, which includes the drawing, and the redraw counters.
+ * That text differs every time, so it is only updated every ten seconds
+ * rather than with the clock.
+ */
+class StatusBar : public egt::Frame {
+public:
+	explicit StatusBar(const std::string& title);
+
+	void provisioned(bool p);
+	void refresh(void);
+
+	// label updates done and avoided because the text didn't change
+	size_t redraws(void) const { return numRedraws; }
+	size_t unchanged(void) const { return numUnchanged; }
+
+private:
+	void setText(egt::Label& label, std::string& shown, const char *text);
+
+	egt::ImageLabel appName;
+	egt::BoxSizer clockSizer;
+	egt::Label dateLabel;
+	egt::Label timeLabel;
+	egt::Label cpuLabel;
+	egt::Label statsLabel;
+	egt::PeriodicTimer timer;
+	egt::experimental::CPUMonitorUsage cpuMon;
+
+	std::string dateShown;
+	std::string timeShown;
+	std::string cpuShown;
+	std::string statsShown;
+	size_t ticks;
+	struct timespec lastCpu;
+	struct timespec lastWall;
+	size_t numRedraws;
+	size_t numUnchanged;
+};
+
+#endif /* __STATUSBAR_H__ */
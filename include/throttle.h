@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __THROTTLE_H__
+#define __THROTTLE_H__
+
+#include <cstdint>
+#include <egt/asio.hpp>
+#include "http.h"
+
+#define THROTTLE_SAMPLE_MS 500
+// the download resumes once the load dropped this far below the limit
+#define THROTTLE_HYSTERESIS 10
+
+typedef struct throttleSettings_t {
+	curl_off_t rate;        // bytes/s, 0 for unlimited
+	int idleLoad;           // % CPU above which the download pauses, 0 never
+	bool idlePriority;      // background threads run with SCHED_IDLE and idle I/O
+} throttleSettings_t;
+
+/*
+ * Keeps a deployment download from competing with the application in the
+ * foreground. The transfer is capped at a fixed rate and paused for as long
+ * as the system CPU load, sampled from /proc/stat like the GUI's CPU
+ * monitor, is above the limit. The pause only stops reading from the
+ * socket, TCP flow control holds the server back and the transfer picks up
+ * where it stopped.
+ */
+class Throttle {
+public:
+	Throttle(asio::io_context& io, HTTP& http);
+
+	void settings(const throttleSettings_t& s);
+	void start(void);
+	void stop(void);
+
+	bool paused(void) const { return isPaused; }
+	size_t pauses(void) const { return numPauses; }
+
+	bool idlePriority(void) const { return config.idlePriority; }
+	// SCHED_IDLE and idle I/O priority for the calling thread
+	static void background(void);
+
+private:
+	void sample(void);
+	int load(void);
+
+	asio::steady_timer timer;
+	HTTP& http;
+	throttleSettings_t config;
+	bool running;
+	bool isPaused;
+	size_t numPauses;
+	uint64_t lastBusy;
+	uint64_t lastTotal;
+};
+
+#endif /* __THROTTLE_H__ */
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __UBOOTENV_H__
+#define __UBOOTENV_H__
+
+#include <string>
+#include <vector>
+#include <array>
+#include <sys/types.h>
+
+struct uboot_ctx;
+
+inline static const std::vector<std::string> ubootEnvVars = {"upgrade_available", "bootcount", "ustate", "boot_slot"};
+inline static const std::vector<std::string> ustateVal = {"0", "1", "2", "3", "4", "5", "6", "7"};
+
+typedef enum ubootEnvVars_t {
+	ENV_UPGRADE = 0,
+	ENV_BOOTCNT,
+	ENV_USTATE,
+	ENV_SLOT,       // "a" or "b", the A/B slot u-boot boots
+	ENV_MAX,
+} ubootEnvVars_t;
+
+typedef enum ustate_t {
+	STATE_OK = 0,
+	STATE_INSTALLED = 1,
+	STATE_TESTING = 2,
+	STATE_FAILED = 3,
+	STATE_NOT_AVAILABLE = 4,
+	STATE_ERROR = 5,
+	STATE_WAIT = 6,
+	STATE_IN_PROGRESS = 7,
+	STATE_LAST = STATE_IN_PROGRESS
+} ustate_t;
+
+/*
+ * The u-boot environment variables used for the update handshake. They are
+ * read once by init() into an in-memory copy; changes go through begin(),
+ * set() and commit(), which opens the env, sets the changed variables and
+ * stores it once. A commit without changes does not touch the flash.
+ */
+class UbootEnv {
+public:
+	UbootEnv();
+
+	size_t init(const std::string& config = "/etc/fw_env.config");
+
+	void begin(void);
+	size_t set(ubootEnvVars_t var, std::string val);
+	size_t commit(void);
+	void abort(void);
+	size_t write(ubootEnvVars_t var, std::string val);
+
+	const std::string& get(ubootEnvVars_t var) const { return shadow.at(var); }
+	ssize_t ustate(void) const { return state; }
+
+private:
+	struct uboot_ctx *ctx;
+	ssize_t state;
+	// values as last stored, and as set by the open transaction
+	std::array<std::string, ENV_MAX> stored;
+	std::array<std::string, ENV_MAX> shadow;
+	std::array<bool, ENV_MAX> dirty;
+	bool txn;
+};
+
+#endif /* __UBOOTENV_H__ */
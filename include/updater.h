@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __UPDATER_H__
+#define __UPDATER_H__
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <egt/asio.hpp>
+#include "version.h"
+#include "configstore.h"
+#include "filewatch.h"
+#include "throttle.h"
+#include "http.h"
+#include "deployment.h"
+#include "installer.h"
+#include "hash.h"
+#include "digestcache.h"
+#include "blockindex.h"
+#include "delta.h"
+#include "ubootenv.h"
+#include "controller.h"
+#include "pollscheduler.h"
+
+// hawkBit rejects configData values longer than this
+#define HAWKBIT_VALUE_MAX 128
+
+static const std::string EGT_SWUPDATE_VERSION = std::to_string(EGT_SWUPDATE_VERSION_MAJOR) + "." + std::to_string(EGT_SWUPDATE_VERSION_MINOR) + "." + std::to_string(EGT_SWUPDATE_VERSION_PATCH);
+
+/*
+ * Everything egt-swupdate does apart from drawing: reads the swupdate config,
+ * hashes the app data, checks in with the Hawkbit server on its polling
+ * interval and downloads and stages offered deployments. It only needs an
+ * asio event loop, the GUI runs it on the EGT application's loop and the
+ * headless daemon on a plain io_context.
+ *
+ * The front end is told about progress through the on* handlers, which are
+ * always called on the event loop.
+ */
+class Updater {
+public:
+	typedef std::function<void(bool ok)> Completion;
+
+	Updater(asio::io_context& io, std::string const cfg);
+	~Updater();
+
+	void start(void);
+	// checks in right away instead of waiting for the poll timer
+	void checkNow(void) { pollScheduler.now(); }
+
+	bool getAttrFromCfg(std::string node, std::string attr, std::string& val);
+	bool getAttrFromCfg(std::string node, std::string attr, int& val);
+	bool getAttrFromCfg(std::string node, std::string attr, bool& val);
+	bool getAttrFromCfg(std::string node, std::string subnode, std::string key, std::string& val);
+
+	// ok is false when no app data digest is available
+	void onHashed(Completion handler) { hashedHandler = handler; }
+	void onCheckIn(Completion handler) { checkInHandler = handler; }
+	// the deployment is staged and the u-boot env set, a reboot installs it
+	void onUpdateReady(std::function<void(void)> handler) { updateReadyHandler = handler; }
+	// the device certificate and key showed up
+	void onProvisioned(std::function<void(void)> handler) { provisionedHandler = handler; }
+	// the config file changed and the new settings are in effect
+	void onConfigReload(std::function<void(void)> handler) { configReloadHandler = handler; }
+
+	bool provisioned(void) const { return isProvisioned; }
+	bool hashing(void) const { return hashPending; }
+	size_t hashPercent(void) const { return hashTotal ? (hashProgress * 100) / hashTotal : 0; }
+	const std::string& appDataDigest(void) const { return appDataMd; }
+	ssize_t pollInterval(void) const { return controller->pollInterval(); }
+	ssize_t nextCheckIn(void) const { return pollScheduler.next(); }
+
+	// logs the time since exec and the resident set size, to compare
+	// the footprint of the GUI and the headless builds
+	static void footprint(const std::string& stage);
+
+private:
+	bool readConfigFile(std::string cfgFile);
+	void getServerAttrs(void);
+	void getIdentifyAttrs(void);
+	void configReloaded(void);
+	void watchCredentials(void);
+	void credentialsChanged(void);
+
+	void getHashAttrs(void);
+	bool hashAppData(std::string file, std::string& digest, std::string& changed, bool verify);
+	void startAppDataHash(void);
+	void appDataHashed(bool ok, std::string digest, std::string changed);
+	void applyDeltas(std::function<void(bool)> done);
+	bool applyDelta(std::string delta);
+	void getPollAttrs(void);
+	void getThrottleAttrs(void);
+	void getInstallAttrs(void);
+	void firstCheckIn(void);
+	void checkIn(Completion done);
+	void pollCycle(PollScheduler::Result done);
+	void fetchDeployment(void);
+
+	asio::io_context& io;
+	ConfigStore swupdateCfg;
+
+	UbootEnv ubootEnv;
+
+	HTTPMulti httpLoop;
+	HTTP updateServer;
+	std::unique_ptr<Controller> controller;
+	PollScheduler pollScheduler;
+	std::unique_ptr<DeploymentFetcher> fetcher;
+	SlotWriter slotWriter;
+	std::string installSlot;
+	bool checkedIn;
+	bool deploying;
+	bool updateStaged;
+
+	std::string uri;
+	std::string sslkey;
+	std::string sslcert;
+
+	FileWatch credentialWatch;
+	std::string certFile;
+	std::string keyFile;
+	bool isProvisioned;
+	bool provisionWaiting;
+	// no watch could be set up, so nothing would end the wait
+	bool credentialsUnwatched;
+
+	std::string metricsFile;
+	Throttle throttle;
+
+	std::string appDataFile;
+	std::string appDataMd;
+	HashEngine hashEngine;
+	std::thread hashWorker;
+	std::atomic<size_t> hashProgress;
+	size_t hashTotal;
+	bool hashPending;
+	bool hashVerifying;
+	DigestCache digestCache;
+	bool digestCacheParanoid;
+	std::string hashTag;
+	BlockIndex blockIndex;
+	std::string appDataChanged;
+	std::string appDataSlot;
+	std::thread deltaWorker;
+	bool checkInWaiting;
+
+	Completion hashedHandler;
+	Completion checkInHandler;
+	std::function<void(void)> updateReadyHandler;
+	std::function<void(void)> configReloadHandler;
+	std::function<void(void)> provisionedHandler;
+};
+
+#endif /* __UPDATER_H__ */
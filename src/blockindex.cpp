@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <set>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "blockindex.h"
+
+using namespace std;
+
+#define BLOCK_INDEX_MAGIC 0x45474231      // "EGB1"
+#define BLOCK_INDEX_VERSION 2
+#define BLOCK_HINT_MAGIC 0x45474831       // "EGH1"
+#define BLOCK_HINT_VERSION 1
+
+static bool identify(const std::string& file, blockIndexHeader_t& hdr) {
+        struct stat st;
+
+        if (stat(file.c_str(), &st) != 0) {
+                cout << "Error reading " << file << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        hdr.dev = st.st_dev;
+        hdr.ino = st.st_ino;
+        hdr.size = st.st_size;
+        hdr.mtimeSec = st.st_mtim.tv_sec;
+        hdr.mtimeNsec = st.st_mtim.tv_nsec;
+        hdr.ctimeSec = st.st_ctim.tv_sec;
+        hdr.ctimeNsec = st.st_ctim.tv_nsec;
+
+        return true;
+}
+
+static bool sameIdentity(const blockIndexHeader_t& a, const blockIndexHeader_t& b) {
+        return (a.dev == b.dev) && (a.ino == b.ino) && (a.size == b.size) &&
+               (a.mtimeSec == b.mtimeSec) && (a.mtimeNsec == b.mtimeNsec) &&
+               (a.ctimeSec == b.ctimeSec) && (a.ctimeNsec == b.ctimeNsec);
+}
+
+BlockIndex::BlockIndex(std::string path) : indexPath(path) {
+        memset(&header, 0, sizeof(header));
+        numRehashed = 0;
+}
+
+bool BlockIndex::load(void) {
+        struct stat st;
+        int fd = open(indexPath.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                return false;
+        }
+
+        bool ok = (fstat(fd, &st) == 0) && (read(fd, &header, sizeof(header)) == sizeof(header)) &&
+                  (header.magic == BLOCK_INDEX_MAGIC) && (header.version == BLOCK_INDEX_VERSION);
+
+        // a truncated or corrupt index must not size the table, it has to
+        // agree with the file it describes and with its own length
+        if ((ok == true) && ((header.blockSize == 0) ||
+            (header.blocks != header.size / header.blockSize + (header.size % header.blockSize ? 1 : 0)) ||
+            (header.blocks > ((uint64_t) st.st_size - sizeof(header)) / SHA256_DIGEST_LENGTH) ||
+            ((uint64_t) st.st_size != sizeof(header) + header.blocks * SHA256_DIGEST_LENGTH))) {
+                cout << "Ignoring corrupt block index " << indexPath << endl;
+                ok = false;
+        }
+
+        if (ok == true) {
+                header.flatSha256[sizeof(header.flatSha256) - 1] = '\0';
+                digests.resize(header.blocks * SHA256_DIGEST_LENGTH);
+                ok = (read(fd, digests.data(), digests.size()) == (ssize_t) digests.size());
+        }
+
+        close(fd);
+
+        if (ok != true) {
+                memset(&header, 0, sizeof(header));
+                digests.clear();
+        }
+
+        return ok;
+}
+
+bool BlockIndex::save(void) {
+        std::string tmp = indexPath + ".tmp";
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(indexPath).parent_path(), ec);
+
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (fd < 0) {
+                cout << "Error opening " << tmp << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        bool ok = (write(fd, &header, sizeof(header)) == sizeof(header)) &&
+                  (write(fd, digests.data(), digests.size()) == (ssize_t) digests.size()) &&
+                  (fsync(fd) == 0);
+        close(fd);
+
+        if ((ok != true) || (rename(tmp.c_str(), indexPath.c_str()) != 0)) {
+                cout << "Error writing block index " << indexPath << endl;
+                unlink(tmp.c_str());
+                return false;
+        }
+
+        return true;
+}
+
+bool BlockIndex::loadHint(const blockIndexHeader_t& cur, size_t blockSize, std::vector<size_t>& dirty, std::string& flatDigest) {
+        std::string path = indexPath + ".hint";
+        blockHintHeader_t hint;
+        std::vector<uint64_t> ranges;
+        struct stat st;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                return false;
+        }
+
+        // only a hint from the indexed file to this very file is any use
+        bool ok = (fstat(fd, &st) == 0) && (read(fd, &hint, sizeof(hint)) == sizeof(hint)) &&
+                  (hint.magic == BLOCK_HINT_MAGIC) && (hint.version == BLOCK_HINT_VERSION) &&
+                  (hint.ranges <= ((uint64_t) st.st_size - sizeof(hint)) / (2 * sizeof(uint64_t))) &&
+                  ((uint64_t) st.st_size == sizeof(hint) + hint.ranges * 2 * sizeof(uint64_t)) &&
+                  sameIdentity(hint.source, header) && sameIdentity(hint.target, cur);
+
+        if (ok == true) {
+                ranges.resize(hint.ranges * 2);
+                ok = (read(fd, ranges.data(), ranges.size() * sizeof(uint64_t)) == (ssize_t) (ranges.size() * sizeof(uint64_t)));
+        }
+
+        close(fd);
+
+        if (ok != true) {
+                return false;
+        }
+
+        std::set<size_t> blocks;
+
+        for (size_t i = 0; i < ranges.size(); i += 2) {
+                uint64_t offset = ranges[i], length = ranges[i + 1];
+
+                if ((offset > cur.size) || (length > cur.size - offset)) {
+                        cout << "Ignoring corrupt block index hint " << path << endl;
+                        return false;
+                }
+
+                for (uint64_t b = offset / blockSize; (length > 0) && (b <= (offset + length - 1) / blockSize); b++) {
+                        blocks.insert(b);
+                }
+        }
+
+        // a last block that changed length and any block past the old end
+        // differ whatever was written into them
+        if (cur.size != header.size) {
+                for (uint64_t b = std::min(cur.size, header.size) / blockSize; b * blockSize < cur.size; b++) {
+                        blocks.insert(b);
+                }
+        }
+
+        hint.target.flatSha256[sizeof(hint.target.flatSha256) - 1] = '\0';
+        flatDigest = hint.target.flatSha256;
+        dirty.assign(blocks.begin(), blocks.end());
+
+        return true;
+}
+
+bool BlockIndex::hint(const std::string& source, const std::string& target, const std::string& targetSha256,
+                      const std::vector<std::pair<uint64_t, uint64_t>>& ranges) const {
+        std::string path = indexPath + ".hint";
+        std::string tmp = path + ".tmp";
+        std::vector<uint64_t> table;
+        blockHintHeader_t hint;
+
+        if (enabled() != true) {
+                return true;
+        }
+
+        memset(&hint, 0, sizeof(hint));
+
+        if ((identify(source, hint.source) != true) || (identify(target, hint.target) != true)) {
+                return false;
+        }
+
+        hint.magic = BLOCK_HINT_MAGIC;
+        hint.version = BLOCK_HINT_VERSION;
+        hint.ranges = ranges.size();
+        strncpy(hint.target.flatSha256, targetSha256.c_str(), sizeof(hint.target.flatSha256) - 1);
+
+        for (const auto& range : ranges) {
+                table.push_back(range.first);
+                table.push_back(range.second);
+        }
+
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (fd < 0) {
+                cout << "Error opening " << tmp << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        bool ok = (write(fd, &hint, sizeof(hint)) == sizeof(hint)) &&
+                  (write(fd, table.data(), table.size() * sizeof(uint64_t)) == (ssize_t) (table.size() * sizeof(uint64_t))) &&
+                  (fsync(fd) == 0);
+        close(fd);
+
+        if ((ok != true) || (rename(tmp.c_str(), path.c_str()) != 0)) {
+                cout << "Error writing block index hint " << path << endl;
+                unlink(tmp.c_str());
+                return false;
+        }
+
+        return true;
+}
+
+bool BlockIndex::lookup(const std::string& file, std::string& flatDigest) {
+        blockIndexHeader_t cur;
+
+        memset(&cur, 0, sizeof(cur));
+
+        if ((enabled() != true) || (identify(file, cur) != true) || (load() != true) || !sameIdentity(header, cur)) {
+                return false;
+        }
+
+        return flat(flatDigest);
+}
+
+bool BlockIndex::update(const std::string& file, HashEngine& engine, std::atomic<size_t> *progress, bool verify) {
+        blockIndexHeader_t cur;
+        std::vector<size_t> dirty;
+        std::string flatDigest;
+        bool flatMode = (engine.mode() == HASH_FLAT);
+        bool loaded;
+
+        changedBlocks.clear();
+        numRehashed = 0;
+
+        memset(&cur, 0, sizeof(cur));
+
+        if (identify(file, cur) != true) {
+                return false;
+        }
+
+        loaded = (load() == true) && (header.blockSize == engine.blockSize());
+
+        // an index written in tree mode has no flat digest to offer
+        bool current = (loaded == true) && sameIdentity(header, cur) && ((flatMode != true) || (header.flatSha256[0] != '\0'));
+
+        if ((current == true) && (verify != true)) {
+                return true;
+        }
+
+        size_t blocks = (cur.size + engine.blockSize() - 1) / engine.blockSize();
+
+        // a check of the index reads everything, a hint without the flat
+        // digest can't save the read in flat mode
+        bool hinted = (loaded == true) && (current != true) && (verify != true) &&
+                      (loadHint(cur, engine.blockSize(), dirty, flatDigest) == true) &&
+                      ((flatMode != true) || (flatDigest.empty() != true));
+
+        if ((hinted == true) && (flatMode != true)) {
+                flatDigest.clear();
+        }
+
+        if (hinted != true) {
+                dirty.clear();
+                flatDigest.clear();
+
+                // nothing tells which blocks were written, all of them are compared
+                for (size_t b = 0; b < blocks; b++) {
+                        dirty.push_back(b);
+                }
+        }
+
+        std::vector<unsigned char> old = digests;
+
+        bool ok = ((flatMode == true) && (hinted != true)) ? engine.hashFileBlocks(file, flatDigest, digests, progress)
+                                                          : engine.hashBlocks(file, dirty, digests, progress);
+
+        if (ok != true) {
+                return false;
+        }
+
+        numRehashed = dirty.size();
+
+        // without a previous index there is nothing to compare against
+        if (loaded == true) {
+                for (size_t b : dirty) {
+                        size_t off = b * SHA256_DIGEST_LENGTH;
+
+                        if ((off + SHA256_DIGEST_LENGTH > old.size()) ||
+                            (memcmp(&old[off], &digests[off], SHA256_DIGEST_LENGTH) != 0)) {
+                                changedBlocks.push_back(b);
+                        }
+                }
+        }
+
+        if ((current == true) && (changedBlocks.empty() != true)) {
+                cout << "Block index " << indexPath << " was stale, " << changedBlocks.size() << " blocks differ" << endl;
+        }
+
+        if ((current == true) && (flatMode == true) && (flatDigest != header.flatSha256)) {
+                cout << "Block index " << indexPath << " was stale, " << header.flatSha256 << " is now " << flatDigest << endl;
+        }
+
+        blockIndexHeader_t after;
+        memset(&after, 0, sizeof(after));
+
+        if ((identify(file, after) != true) || !sameIdentity(cur, after)) {
+                cout << file << " changed while it was hashed, not updating the block index" << endl;
+                return false;
+        }
+
+        header = cur;
+        header.magic = BLOCK_INDEX_MAGIC;
+        header.version = BLOCK_INDEX_VERSION;
+        header.blockSize = engine.blockSize();
+        header.blocks = blocks;
+        strncpy(header.flatSha256, flatDigest.c_str(), sizeof(header.flatSha256) - 1);
+
+        if (save() != true) {
+                return false;
+        }
+
+        // the hint named the old identity as its source, it is used up or
+        // stale now
+        if (current != true) {
+                unlink((indexPath + ".hint").c_str());
+        }
+
+        return true;
+}
+
+bool BlockIndex::root(std::string& digest) const {
+        unsigned char md[SHA256_DIGEST_LENGTH];
+
+        if (HashEngine::treeRoot(digests, md) != true) {
+                return false;
+        }
+
+        digest = HashEngine::toHex(md, sizeof(md));
+
+        return true;
+}
+
+bool BlockIndex::flat(std::string& digest) const {
+        if (header.flatSha256[0] == '\0') {
+                return false;
+        }
+
+        digest = header.flatSha256;
+
+        return true;
+}
+
+std::string BlockIndex::ranges(const std::vector<size_t>& blocks, size_t maxLen) {
+        std::string out;
+        size_t i = 0;
+
+        while (i < blocks.size()) {
+                size_t j = i;
+
+                while ((j + 1 < blocks.size()) && (blocks[j + 1] == blocks[j] + 1)) {
+                        j++;
+                }
+
+                std::string range = std::to_string(blocks[i]);
+                if (j > i) {
+                        range += "-" + std::to_string(blocks[j]);
+                }
+
+                std::string more = ",+" + std::to_string(blocks.size() - i);
+
+                // leave room to say how many blocks were left out
+                if (out.size() + range.size() + 1 + more.size() > maxLen) {
+                        out += more;
+                        break;
+                }
+
+                out += (out.empty() ? "" : ",") + range;
+                i = j + 1;
+        }
+
+        return out;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <charconv>
+#include "libconfig.h++"
+#include "configstore.h"
+
+using namespace std;
+
+static bool scalar(const libconfig::Setting& s, std::string& val) {
+        switch (s.getType()) {
+        case libconfig::Setting::TypeString:
+                val = (const char *) s;
+                return true;
+        case libconfig::Setting::TypeInt:
+                val = std::to_string((int) s);
+                return true;
+        case libconfig::Setting::TypeInt64:
+                val = std::to_string((long long) s);
+                return true;
+        case libconfig::Setting::TypeFloat:
+                val = std::to_string((double) s);
+                return true;
+        case libconfig::Setting::TypeBoolean:
+                val = (bool) s ? "true" : "false";
+                return true;
+        default:
+                return false;
+        }
+}
+
+static void add(const libconfig::Setting& s, const std::string& path, std::unordered_map<std::string, std::string>& idx) {
+        std::string val;
+
+        if (scalar(s, val) == true) {
+                idx[path] = val;
+        } else if (s.isGroup() == true) {
+                for (int i = 0; i < s.getLength(); i++) {
+                        add(s[i], path + "/" + s[i].getName(), idx);
+                }
+        } else if (s.isList() == true) {
+                // list entries are addressed by their name member
+                for (int i = 0; i < s.getLength(); i++) {
+                        std::string name;
+
+                        if ((s[i].isGroup() == true) && (s[i].lookupValue("name", name) == true)) {
+                                add(s[i], path + "/" + name, idx);
+                        }
+                }
+        }
+}
+
+ConfigStore::ConfigStore(asio::io_context& io) : watcher(io) {
+        numReloads = 0;
+}
+
+bool ConfigStore::parse(const std::string& file, index_t& idx) {
+        libconfig::Config cfg;
+
+        try {
+                cfg.readFile(file.c_str());
+        } catch(const libconfig::FileIOException &fioex) {
+                std::cerr << "I/O error while reading config file." << std::endl;
+                return false;
+        } catch(const libconfig::ParseException &pex) {
+                std::cerr << "Parse error at " << pex.getFile() << ":" << pex.getLine() << " - " << pex.getError() << std::endl;
+                return false;
+        }
+
+        const libconfig::Setting& root = cfg.getRoot();
+
+        for (int i = 0; i < root.getLength(); i++) {
+                add(root[i], root[i].getName(), idx);
+        }
+
+        return true;
+}
+
+bool ConfigStore::load(const std::string& file) {
+        index_t idx;
+
+        cfgFile = file;
+
+        if (parse(file, idx) != true) {
+                return false;
+        }
+
+        index.swap(idx);
+
+        return true;
+}
+
+bool ConfigStore::watch(Reloaded handler) {
+        reloadedHandler = handler;
+
+        watcher.onChanged([this]() {
+                changed();
+        });
+
+        if (watcher.add(cfgFile) != true) {
+                cout << "Changes to " << cfgFile << " need a restart" << endl;
+                return false;
+        }
+
+        return true;
+}
+
+void ConfigStore::changed(void) {
+        index_t idx;
+
+        if (parse(cfgFile, idx) != true) {
+                cout << "Keeping the previous settings of " << cfgFile << endl;
+                return;
+        }
+
+        // touched or rewritten with the same content
+        if (idx == index) {
+                return;
+        }
+
+        index.swap(idx);
+        numReloads++;
+
+        cout << "Reloaded " << cfgFile << endl;
+
+        if (reloadedHandler) {
+                reloadedHandler();
+        }
+}
+
+const std::string* ConfigStore::lookup(const std::string& path) const {
+        auto it = index.find(path);
+
+        return (it == index.end()) ? NULL : &it->second;
+}
+
+bool ConfigStore::get(const std::string& node, const std::string& key, std::string& val) const {
+        const std::string *s = lookup(node + "/" + key);
+
+        if (s == NULL) {
+                return false;
+        }
+
+        val = *s;
+
+        return true;
+}
+
+bool ConfigStore::get(const std::string& node, const std::string& key, int& val) const {
+        const std::string *s = lookup(node + "/" + key);
+
+        if (s == NULL) {
+                return false;
+        }
+
+        auto res = std::from_chars(s->data(), s->data() + s->size(), val);
+
+        return (res.ec == std::errc()) && (res.ptr == s->data() + s->size());
+}
+
+bool ConfigStore::get(const std::string& node, const std::string& key, bool& val) const {
+        const std::string *s = lookup(node + "/" + key);
+
+        if ((s == NULL) || ((*s != "true") && (*s != "false"))) {
+                return false;
+        }
+
+        val = (*s == "true");
+
+        return true;
+}
+
+bool ConfigStore::get(const std::string& node, const std::string& subnode, const std::string& key, std::string& val) const {
+        return get(node + "/" + subnode, key, val);
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <ctime>
+#include "controller.h"
+
+using namespace std;
+
+Controller::Controller(HTTP& http, std::string uri, std::string sslkey, std::string sslcert, std::string id, UbootEnv *env) :
+        http(http), env(env), baseUri(uri), key(sslkey), cert(sslcert), id(id), configUri(uri + "/configData") {
+        pollInFlight = false;
+        serverPollTime = DEFAULT_POLL_TIME;
+        actionId = 0;
+        available = false;
+        installed = false;
+        httpStatus = 0;
+        retryDelay = 0;
+        configRequested = true;
+        numUnchanged = 0;
+        numSkipped = 0;
+        sentGeneration = 0;
+        payload.id(id);
+}
+
+void Controller::server(std::string uri, std::string sslkey, std::string sslcert, std::string id) {
+        if ((uri == baseUri) && (sslkey == key) && (sslcert == cert) && (id == this->id)) {
+                return;
+        }
+
+        http.invalidate(baseUri);
+
+        baseUri = uri;
+        configUri = uri + "/configData";
+        key = sslkey;
+        cert = sslcert;
+        this->id = id;
+        payload.id(id);
+
+        lastPoll.clear();
+        configRequested = true;
+}
+
+void Controller::checkIfUpdated(void) {
+        if (env == NULL) {
+                return;
+        }
+
+        if ((env->ustate() == STATE_INSTALLED) || (env->ustate() == STATE_TESTING)) {
+                cout << "Software Updated successfully!" << endl;
+                installed = true;
+
+                // the new software booted, end the trial in one store
+                env->begin();
+                env->set(ENV_USTATE, ustateVal.at(STATE_OK));
+                env->set(ENV_UPGRADE, "0");
+                env->set(ENV_BOOTCNT, "0");
+                env->commit();
+        }
+}
+
+void Controller::confirmInstalled(void) {
+        installed = true;
+        available = false;
+}
+
+size_t Controller::markUpdateAvailable(const std::string& slot) {
+        if (env == NULL) {
+                return 0;
+        }
+
+        env->begin();
+
+        if ((env->set(ENV_UPGRADE, "1") != 0) || (env->set(ENV_BOOTCNT, "0") != 0) ||
+            ((slot.empty() != true) && (env->set(ENV_SLOT, slot) != 0))) {
+                env->abort();
+                return -1;
+        }
+
+        return env->commit();
+}
+
+void Controller::checkIn(Completion done) {
+        poll([this, done](bool ok) {
+                // an unreachable or overloaded server gets no status report
+                // on top of the failed poll
+                if (ok != true) {
+                        if (done) {
+                                done(false);
+                        }
+                        return;
+                }
+
+                sendStatus(done);
+        });
+}
+
+void Controller::poll(Completion done) {
+        if (pollInFlight == true) {
+                cout << "Previous check-in still in progress, skipping poll" << endl;
+
+                // the caller still has to hear back, the scheduler would
+                // wait for this poll forever
+                if (done) {
+                        done(false);
+                }
+                return;
+        }
+
+        pollInFlight = true;
+
+        http.get(baseUri, key, cert, [this, done](bool ok, long status, std::string_view res) {
+                bool handled = false;
+
+                response(status);
+
+                // the state from the last parsed answer still holds when
+                // the server says nothing changed
+                if ((ok == true) && (lastPoll.empty() != true) && ((status == 304) || ((status == 200) && (res == lastPoll)))) {
+                        numUnchanged++;
+                        handled = true;
+                } else if ((ok == true) && (status == 200)) {
+                        handled = handlePollResponse(res);
+                        lastPoll = handled ? std::string(res) : std::string();
+                }
+
+                // without a parsed answer to fall back on, the next poll
+                // has to fetch the full body again
+                if (handled != true) {
+                        http.invalidate(baseUri);
+                }
+
+                pollInFlight = false;
+
+                if (done) {
+                        done(handled);
+                }
+        }, true);
+}
+
+bool Controller::handlePollResponse(std::string_view res) {
+        ddiPoll_t poll;
+        ddiError_t err = ddiParsePoll(res, poll);
+
+        if (err != DDI_OK) {
+                cout << "Error parsing poll response: " << ddiErrorString(err) << endl;
+                return false;
+        }
+
+        if (poll.sleep >= 0) {
+                serverPollTime = poll.sleep;
+        } else {
+                cout << "Warning, did not get polling time from server, setting to default 5 minutes" << endl;
+                serverPollTime = DEFAULT_POLL_TIME;
+        }
+
+        // the server lists configData while it wants the attributes
+        configRequested = (poll.configData.empty() != true);
+
+        if (poll.cancelId >= 0) {
+                cout << "Server asked to cancel action " << poll.cancelId << ", cancelling is not supported" << endl;
+        }
+
+        if (poll.actionId >= 0) {
+                deployment = poll.deploymentBase;
+                actionId = poll.actionId;
+
+                // check if an update was recently installed or if one is available
+                if (installed == false) {
+                        cout << "Update available with actionId: " << actionId << endl;
+                        available = true;
+                }
+        }
+
+        return true;
+}
+
+void Controller::response(long status) {
+        httpStatus = status;
+        retryDelay = ((status == 429) || (status == 503)) ? http.retryAfter() : 0;
+}
+
+void Controller::sendStatus(Completion done) {
+        // the attributes the server already has are not sent again unless
+        // it asks for them
+        if ((installed == false) && (configRequested == false) && (payload.generation() == sentGeneration)) {
+                numSkipped++;
+
+                if (done) {
+                        done(true);
+                }
+                return;
+        }
+
+        std::string_view body = payload.build(std::time({}));
+
+        auto complete = [this, done](bool ok, long status, std::string_view res) {
+                response(status);
+
+                if (done) {
+                        done((ok == true) && (status >= 200) && (status < 300));
+                }
+        };
+
+        if (installed == true) {
+                installed = false;
+
+                // acknowledge update to Hawkbit server
+                http.post(baseUri + "/deploymentBase/" + std::to_string(actionId) + "/feedback", key, cert, body.data(), body.size(), complete);
+        } else {
+                // send version info to Hawkbit server
+                http.put(configUri, key, cert, body.data(), body.size(),
+                         [this, complete, sent = payload.generation()](bool ok, long status, std::string_view res) {
+                        if ((ok == true) && (status >= 200) && (status < 300)) {
+                                sentGeneration = sent;
+                                configRequested = false;
+                        }
+
+                        complete(ok, status, res);
+                });
+        }
+}
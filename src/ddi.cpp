@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <charconv>
+#include <climits>
+#include <nlohmann/json.hpp>
+#include "ddi.h"
+
+using json = nlohmann::json;
+
+// real answers are a handful of levels deep
+#define DDI_MAX_DEPTH 16
+
+/*
+ * Keeps track of where in the document the parser is as a path like
+ * "/config/polling/sleep", array elements show up as "[]". Subclasses only
+ * see the objects entered and left and the string and number values with
+ * their path, everything else is skipped.
+ */
+class DdiSax : public nlohmann::json_sax<json> {
+public:
+        DdiSax() : err(DDI_OK) {}
+
+        bool null() override { return true; }
+        bool boolean(bool val) override { return true; }
+        bool number_integer(number_integer_t val) override { return number(val < 0 ? -1 : val); }
+        bool number_unsigned(number_unsigned_t val) override { return number(val > SSIZE_MAX ? -1 : val); }
+        bool number_float(number_float_t val, const string_t& s) override { return true; }
+        bool binary(binary_t& val) override { return true; }
+
+        bool string(string_t& val) override {
+                size_t len = path.size();
+
+                push();
+                bool ok = onString(path, val);
+                path.resize(len);
+
+                return ok;
+        }
+
+        bool key(string_t& val) override {
+                current = val;
+                return true;
+        }
+
+        bool start_object(std::size_t elements) override { return enter(false); }
+        bool end_object() override { return leave(); }
+        bool start_array(std::size_t elements) override { return enter(true); }
+        bool end_array() override { return leave(); }
+
+        bool parse_error(std::size_t position, const std::string& last_token, const nlohmann::detail::exception& ex) override {
+                err = DDI_ERR_SYNTAX;
+                return false;
+        }
+
+        ddiError_t err;
+
+protected:
+        virtual bool onEnter(const std::string& p) { return true; }
+        virtual bool onLeave(const std::string& p) { return true; }
+        virtual bool onString(const std::string& p, const std::string& val) { return true; }
+        virtual bool onNumber(const std::string& p, ssize_t val) { return true; }
+
+        bool fail(ddiError_t e) {
+                err = e;
+                return false;
+        }
+
+private:
+        typedef struct frame_t {
+                size_t len;
+                bool array;
+        } frame_t;
+
+        void push(void) {
+                if (frames.empty() != true) {
+                        path += '/';
+                        path += frames.back().array ? std::string_view("[]") : std::string_view(current);
+                }
+        }
+
+        bool number(ssize_t val) {
+                size_t len = path.size();
+
+                push();
+                bool ok = onNumber(path, val);
+                path.resize(len);
+
+                return ok;
+        }
+
+        bool enter(bool array) {
+                size_t len = path.size();
+
+                if (frames.size() == DDI_MAX_DEPTH) {
+                        return fail(DDI_ERR_SYNTAX);
+                }
+
+                push();
+                frames.push_back({len, array});
+
+                return onEnter(path);
+        }
+
+        bool leave(void) {
+                bool ok = onLeave(path);
+
+                path.resize(frames.back().len);
+                frames.pop_back();
+
+                return ok;
+        }
+
+        std::string path;
+        std::string current;
+        std::vector<frame_t> frames;
+};
+
+// the id is the path segment after marker, up to the query
+static bool hrefId(const std::string& href, const std::string& marker, ssize_t& id) {
+        size_t start = href.find(marker);
+
+        if (start == std::string::npos) {
+                return false;
+        }
+
+        start += marker.size();
+
+        size_t end = href.find_first_of("/?", start);
+        const char *last = href.data() + ((end == std::string::npos) ? href.size() : end);
+        auto res = std::from_chars(href.data() + start, last, id);
+
+        return (res.ec == std::errc()) && (res.ptr == last) && (id >= 0);
+}
+
+// "HH:MM:SS"
+static bool parseSleep(const std::string& s, ssize_t& seconds) {
+        const char *p = s.data();
+        const char *end = s.data() + s.size();
+        ssize_t total = 0;
+
+        for (size_t i = 0; i < 3; i++) {
+                ssize_t v;
+                auto res = std::from_chars(p, end, v);
+
+                if ((res.ec != std::errc()) || (v < 0) || ((i > 0) && (v > 59))) {
+                        return false;
+                }
+
+                total = total * 60 + v;
+                p = res.ptr;
+
+                if (i < 2) {
+                        if ((p == end) || (*p != ':')) {
+                                return false;
+                        }
+                        p++;
+                }
+        }
+
+        if (p != end) {
+                return false;
+        }
+
+        seconds = total;
+
+        return true;
+}
+
+class PollSax : public DdiSax {
+public:
+        explicit PollSax(ddiPoll_t& poll) : poll(poll), config(false) {}
+
+        ddiPoll_t& poll;
+        bool config;
+
+protected:
+        bool onEnter(const std::string& p) override {
+                if (p == "/config") {
+                        config = true;
+                }
+                return true;
+        }
+
+        bool onString(const std::string& p, const std::string& val) override {
+                if (p == "/config/polling/sleep") {
+                        return parseSleep(val, poll.sleep) ? true : fail(DDI_ERR_VALUE);
+                } else if (p == "/_links/deploymentBase/href") {
+                        poll.deploymentBase = val;
+                        return hrefId(val, "/deploymentBase/", poll.actionId) ? true : fail(DDI_ERR_VALUE);
+                } else if (p == "/_links/cancelAction/href") {
+                        poll.cancelAction = val;
+                        return hrefId(val, "/cancelAction/", poll.cancelId) ? true : fail(DDI_ERR_VALUE);
+                } else if (p == "/_links/configData/href") {
+                        poll.configData = val;
+                }
+                return true;
+        }
+
+        bool onNumber(const std::string& p, ssize_t val) override {
+                if ((p == "/config/polling/sleep") || p.starts_with("/_links/")) {
+                        return fail(DDI_ERR_VALUE);
+                }
+                return true;
+        }
+};
+
+class DeploymentSax : public DdiSax {
+public:
+        explicit DeploymentSax(ddiDeployment_t& deployment) : deployment(deployment), id(false), inArtifact(false), chunkStart(0) {}
+
+        ddiDeployment_t& deployment;
+        bool id;
+
+protected:
+        bool onEnter(const std::string& p) override {
+                if (p == ARTIFACT) {
+                        deployment.artifacts.push_back({"", "", "", 0, "", 0});
+                        httpHref.clear();
+                        inArtifact = true;
+                } else if (p == CHUNK) {
+                        chunkStart = deployment.artifacts.size();
+                        metadata.clear();
+                } else if (p == METADATA) {
+                        metadata.emplace_back();
+                }
+                return true;
+        }
+
+        bool onLeave(const std::string& p) override {
+                if (p == CHUNK) {
+                        return applyMetadata();
+                }
+
+                if ((p != ARTIFACT) || (inArtifact == false)) {
+                        return true;
+                }
+
+                inArtifact = false;
+
+                artifact_t& a = deployment.artifacts.back();
+
+                // prefer the https link, download-http is the plain HTTP one
+                if (a.href.empty()) {
+                        a.href = httpHref;
+                }
+
+                if (a.filename.empty() || a.sha256.empty() || a.href.empty()) {
+                        return fail(DDI_ERR_MISSING);
+                }
+                return true;
+        }
+
+        bool onString(const std::string& p, const std::string& val) override {
+                if (p == "/id") {
+                        auto res = std::from_chars(val.data(), val.data() + val.size(), deployment.id);
+                        id = (res.ec == std::errc()) && (res.ptr == val.data() + val.size());
+                        return id ? true : fail(DDI_ERR_VALUE);
+                } else if (p == "/deployment/download") {
+                        deployment.download = val;
+                } else if (p == "/deployment/update") {
+                        deployment.update = val;
+                } else if ((metadata.empty() != true) && (p == METADATA_KEY)) {
+                        metadata.back().first = val;
+                } else if ((metadata.empty() != true) && (p == METADATA_VALUE)) {
+                        metadata.back().second = val;
+                } else if ((inArtifact == true) && p.starts_with(ARTIFACT)) {
+                        std::string_view field = std::string_view(p).substr(std::string_view(ARTIFACT).size());
+                        artifact_t& a = deployment.artifacts.back();
+
+                        if (field == "/filename") {
+                                a.filename = val;
+                        } else if (field == "/hashes/sha256") {
+                                a.sha256 = val;
+                        } else if (field == "/_links/download/href") {
+                                a.href = val;
+                        } else if (field == "/_links/download-http/href") {
+                                httpHref = val;
+                        } else if (field == "/size") {
+                                return fail(DDI_ERR_VALUE);
+                        }
+                }
+                return true;
+        }
+
+        bool onNumber(const std::string& p, ssize_t val) override {
+                if (p == "/id") {
+                        deployment.id = val;
+                        id = (val >= 0);
+                        return id ? true : fail(DDI_ERR_VALUE);
+                } else if ((inArtifact == true) && p.starts_with(ARTIFACT) && (std::string_view(p).substr(std::string_view(ARTIFACT).size()) == "/size")) {
+                        if (val < 0) {
+                                return fail(DDI_ERR_VALUE);
+                        }
+                        deployment.artifacts.back().size = val;
+                }
+                return true;
+        }
+
+private:
+        // metadata and artifacts of a chunk come in any order
+        bool applyMetadata(void) {
+                for (size_t i = chunkStart; i < deployment.artifacts.size(); i++) {
+                        artifact_t& a = deployment.artifacts[i];
+
+                        for (const auto& m : metadata) {
+                                if (m.first == a.filename + ".unpacked_sha256") {
+                                        a.unpackedSha256 = m.second;
+                                } else if (m.first == a.filename + ".unpacked_size") {
+                                        auto res = std::from_chars(m.second.data(), m.second.data() + m.second.size(), a.unpackedSize);
+
+                                        if ((res.ec != std::errc()) || (res.ptr != m.second.data() + m.second.size())) {
+                                                return fail(DDI_ERR_VALUE);
+                                        }
+                                }
+                        }
+                }
+                return true;
+        }
+
+        static constexpr const char *CHUNK = "/deployment/chunks/[]";
+        static constexpr const char *ARTIFACT = "/deployment/chunks/[]/artifacts/[]";
+        static constexpr const char *METADATA = "/deployment/chunks/[]/metadata/[]";
+        static constexpr const char *METADATA_KEY = "/deployment/chunks/[]/metadata/[]/key";
+        static constexpr const char *METADATA_VALUE = "/deployment/chunks/[]/metadata/[]/value";
+
+        std::string httpHref;
+        bool inArtifact;
+        size_t chunkStart;
+        std::vector<std::pair<std::string, std::string>> metadata;
+};
+
+static ddiError_t parse(std::string_view body, DdiSax& sax) {
+        try {
+                if (json::sax_parse(body, &sax) != true) {
+                        return (sax.err != DDI_OK) ? sax.err : DDI_ERR_SYNTAX;
+                }
+        } catch (const json::exception& e) {
+                return DDI_ERR_SYNTAX;
+        }
+
+        return sax.err;
+}
+
+ddiError_t ddiParsePoll(std::string_view body, ddiPoll_t& poll) {
+        PollSax sax(poll);
+
+        poll = {-1, "", -1, "", -1, ""};
+
+        ddiError_t err = parse(body, sax);
+
+        if ((err == DDI_OK) && (sax.config == false)) {
+                return DDI_ERR_MISSING;
+        }
+
+        return err;
+}
+
+ddiError_t ddiParseDeployment(std::string_view body, ddiDeployment_t& deployment) {
+        DeploymentSax sax(deployment);
+
+        deployment = {-1, "", "", {}};
+
+        ddiError_t err = parse(body, sax);
+
+        if ((err == DDI_OK) && (deployment.artifacts.empty() || (sax.id == false))) {
+                return DDI_ERR_MISSING;
+        }
+
+        return err;
+}
+
+const char* ddiErrorString(ddiError_t err) {
+        switch (err) {
+        case DDI_OK:
+                return "ok";
+        case DDI_ERR_SYNTAX:
+                return "malformed JSON";
+        case DDI_ERR_MISSING:
+                return "required field missing";
+        case DDI_ERR_VALUE:
+                return "field has an invalid value";
+        }
+
+        return "unknown error";
+}
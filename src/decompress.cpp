@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include "decompress.h"
+#include "hash.h"
+
+using namespace std;
+
+// the xz decoder's own state on top of the dictionary
+#define DECOMPRESS_XZ_OVERHEAD (1024 * 1024)
+
+Decompressor::Decompressor() : xz(LZMA_STREAM_INIT) {
+        type = COMPRESSION_NONE;
+        sink = NULL;
+        zstd = NULL;
+        xzOpen = false;
+        mdCtx = NULL;
+        windowMB = DECOMPRESS_WINDOW_MB;
+        threads = 0;
+        numIn = 0;
+        numOut = 0;
+        ended = false;
+        failed = false;
+}
+
+Decompressor::~Decompressor() {
+        close();
+}
+
+compression_t Decompressor::detect(const std::string& filename) {
+        if (filename.ends_with(".zst")) {
+                return COMPRESSION_ZSTD;
+        } else if (filename.ends_with(".xz")) {
+                return COMPRESSION_XZ;
+        }
+
+        return COMPRESSION_NONE;
+}
+
+std::string Decompressor::strip(const std::string& filename) {
+        switch (detect(filename)) {
+        case COMPRESSION_ZSTD:
+                return filename.substr(0, filename.size() - 4);
+        case COMPRESSION_XZ:
+                return filename.substr(0, filename.size() - 3);
+        default:
+                return filename;
+        }
+}
+
+const char* Decompressor::name(compression_t type) {
+        switch (type) {
+        case COMPRESSION_ZSTD:
+                return "zstd";
+        case COMPRESSION_XZ:
+                return "xz";
+        default:
+                return "none";
+        }
+}
+
+void Decompressor::limits(size_t windowMB, size_t threads) {
+        this->windowMB = std::max(windowMB, (size_t) 1);
+        this->threads = threads;
+}
+
+bool Decompressor::open(compression_t type, HTTPSink *out) {
+        size_t window = windowMB * 1024 * 1024;
+
+        close();
+
+        this->type = type;
+        sink = out;
+        numIn = 0;
+        numOut = 0;
+        ended = false;
+        failed = false;
+        outBuf.resize(DECOMPRESS_OUT_SIZE);
+
+        if (type == COMPRESSION_ZSTD) {
+                int windowLog = 20;
+
+                while (((size_t) 2 << windowLog) <= window) {
+                        windowLog++;
+                }
+
+                zstd = ZSTD_createDCtx();
+
+                if ((zstd == NULL) || ZSTD_isError(ZSTD_DCtx_setParameter(zstd, ZSTD_d_windowLogMax, windowLog))) {
+                        cout << "Error setting up zstd decoder" << endl;
+                        close();
+                        return false;
+                }
+        } else if (type == COMPRESSION_XZ) {
+                // 0 when the number of cores is unknown
+                unsigned int hc = std::thread::hardware_concurrency();
+                size_t n = threads ? threads : ((hc > 1) ? hc - 1 : 1);
+                uint64_t memlimit = window + DECOMPRESS_XZ_OVERHEAD;
+                lzma_ret ret;
+
+                if (n > 1) {
+                        lzma_mt mt = {};
+
+                        mt.flags = LZMA_CONCATENATED;
+                        mt.threads = n;
+                        // more threads only as long as they fit in the limit
+                        mt.memlimit_threading = memlimit;
+                        mt.memlimit_stop = memlimit;
+                        ret = lzma_stream_decoder_mt(&xz, &mt);
+                } else {
+                        ret = lzma_stream_decoder(&xz, memlimit, LZMA_CONCATENATED);
+                }
+
+                if (ret != LZMA_OK) {
+                        cout << "Error setting up xz decoder: " << ret << endl;
+                        close();
+                        return false;
+                }
+
+                xzOpen = true;
+        } else {
+                cout << "Unknown compression" << endl;
+                return false;
+        }
+
+        mdCtx = EVP_MD_CTX_new();
+
+        if ((mdCtx == NULL) || (EVP_DigestInit_ex(mdCtx, EVP_sha256(), NULL) != 1)) {
+                cout << "Error initializing SHA-256" << endl;
+                close();
+                return false;
+        }
+
+        return true;
+}
+
+bool Decompressor::start(long status) {
+        return sink->start(status);
+}
+
+bool Decompressor::write(const char *data, size_t size) {
+        if ((mdCtx == NULL) || (failed == true)) {
+                return false;
+        }
+
+        numIn += size;
+
+        if (EVP_DigestUpdate(mdCtx, data, size) != 1) {
+                cout << "SHA-256 update failed" << endl;
+                failed = true;
+                return false;
+        }
+
+        bool ok = (type == COMPRESSION_ZSTD) ? decodeZstd(data, size) : decodeXz(data, size, LZMA_RUN);
+
+        if (ok != true) {
+                failed = true;
+        }
+
+        return ok;
+}
+
+bool Decompressor::decodeZstd(const char *data, size_t size) {
+        ZSTD_inBuffer in = {data, size, 0};
+
+        for (;;) {
+                ZSTD_outBuffer out = {outBuf.data(), outBuf.size(), 0};
+                size_t consumed = in.pos;
+                size_t ret = ZSTD_decompressStream(zstd, &out, &in);
+
+                if (ZSTD_isError(ret)) {
+                        cout << "Error unpacking zstd data: " << ZSTD_getErrorName(ret) << endl;
+                        return false;
+                }
+
+                if ((out.pos > 0) && (forward(out.pos) != true)) {
+                        return false;
+                }
+
+                // 0 at the end of a frame, another one may follow
+                if (ret == 0) {
+                        ended = true;
+                } else if ((in.pos > consumed) || (out.pos > 0)) {
+                        ended = false;
+                }
+
+                // with room left in the output everything buffered is out
+                if ((in.pos == in.size) && (out.pos < out.size)) {
+                        return true;
+                }
+        }
+}
+
+bool Decompressor::decodeXz(const char *data, size_t size, lzma_action action) {
+        xz.next_in = (const uint8_t*) data;
+        xz.avail_in = size;
+
+        for (;;) {
+                xz.next_out = (uint8_t*) outBuf.data();
+                xz.avail_out = outBuf.size();
+
+                lzma_ret ret = lzma_code(&xz, action);
+                size_t len = outBuf.size() - xz.avail_out;
+
+                if ((len > 0) && (forward(len) != true)) {
+                        return false;
+                }
+
+                if (ret == LZMA_STREAM_END) {
+                        ended = true;
+                        return true;
+                }
+
+                if (ret == LZMA_MEMLIMIT_ERROR) {
+                        cout << "xz data needs more than the " << windowMB << " MiB window" << endl;
+                        return false;
+                } else if (ret != LZMA_OK) {
+                        cout << "Error unpacking xz data: " << ret << endl;
+                        return false;
+                }
+
+                if ((action == LZMA_RUN) && (xz.avail_in == 0) && (xz.avail_out > 0)) {
+                        return true;
+                }
+        }
+}
+
+bool Decompressor::forward(size_t len) {
+        numOut += len;
+
+        return sink->write(outBuf.data(), len);
+}
+
+bool Decompressor::finish(std::string& digest) {
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int mdLen = 0;
+        bool ok = (mdCtx != NULL) && (failed != true);
+
+        // concatenated xz streams only end when told there is no more input
+        if (ok && (type == COMPRESSION_XZ)) {
+                ok = decodeXz(NULL, 0, LZMA_FINISH);
+        }
+
+        if (ok && (ended != true)) {
+                cout << "Compressed data ends in the middle of a " << name(type) << " frame" << endl;
+                ok = false;
+        }
+
+        if (ok && (EVP_DigestFinal_ex(mdCtx, md, &mdLen) == 1)) {
+                digest = HashEngine::toHex(md, mdLen);
+        } else {
+                ok = false;
+        }
+
+        close();
+
+        return ok;
+}
+
+void Decompressor::close(void) {
+        if (zstd != NULL) {
+                ZSTD_freeDCtx(zstd);
+                zstd = NULL;
+        }
+
+        if (xzOpen == true) {
+                lzma_end(&xz);
+                xz = LZMA_STREAM_INIT;
+                xzOpen = false;
+        }
+
+        if (mdCtx != NULL) {
+                EVP_MD_CTX_free(mdCtx);
+                mdCtx = NULL;
+        }
+}
+
+size_t Decompressor::memory(void) const {
+        if (zstd != NULL) {
+                return ZSTD_sizeof_DCtx(zstd);
+        } else if (xzOpen == true) {
+                return lzma_memusage(&xz);
+        }
+
+        return 0;
+}
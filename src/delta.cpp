@@ -0,0 +1,589 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "delta.h"
+#include "hash.h"
+
+using namespace std;
+
+#define DELTA_MAGIC "EGTDELTA"
+#define DELTA_VERSION 2
+#define DELTA_MAX_CANDIDATES 8
+
+static size_t opSize(uint8_t op) {
+        switch (op) {
+        case DELTA_COPY:
+                return 1 + 2 * sizeof(uint64_t);
+        case DELTA_DATA:
+                return 1 + sizeof(uint64_t);
+        case DELTA_END:
+                return 1;
+        default:
+                return 0;
+        }
+}
+
+static uint64_t getLe64(const char *p) {
+        uint64_t v;
+
+        memcpy(&v, p, sizeof(v));
+
+        return le64toh(v);
+}
+
+DeltaPatcher::DeltaPatcher() {
+        srcFd = -1;
+        dstFd = -1;
+        memset(&header, 0, sizeof(header));
+        haveHeader = false;
+        done = false;
+        failed = false;
+        literalLeft = 0;
+        dstOffset = 0;
+        numCopied = 0;
+        numLiteral = 0;
+}
+
+DeltaPatcher::~DeltaPatcher() {
+        close();
+}
+
+bool DeltaPatcher::open(const std::string& source, const std::string& target, const std::string& sourceSha256) {
+        close();
+
+        haveHeader = false;
+        done = false;
+        failed = false;
+        pending.clear();
+        literalLeft = 0;
+        dstOffset = 0;
+        numCopied = 0;
+        numLiteral = 0;
+        changedRanges.clear();
+        targetPath = target;
+        sourceDigest = sourceSha256;
+
+        if (sourceDigest.size() != sizeof(header.sourceSha256)) {
+                cout << "No digest of " << source << " to check the delta against" << endl;
+                return false;
+        }
+
+        srcFd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (srcFd < 0) {
+                cout << "Error opening " << source << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        copyBuf.resize(DELTA_CHUNK_SIZE);
+
+        return true;
+}
+
+void DeltaPatcher::close(void) {
+        if (srcFd >= 0) {
+                ::close(srcFd);
+                srcFd = -1;
+        }
+
+        if (dstFd >= 0) {
+                ::close(dstFd);
+                dstFd = -1;
+        }
+}
+
+bool DeltaPatcher::parseHeader(void) {
+        struct stat st;
+
+        memcpy(&header, pending.data(), sizeof(header));
+
+        if ((memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) != 0) || (le32toh(header.version) != DELTA_VERSION)) {
+                cout << "Not a supported delta" << endl;
+                return false;
+        }
+
+        header.version = le32toh(header.version);
+        header.blockSize = le32toh(header.blockSize);
+        header.sourceSize = le64toh(header.sourceSize);
+        header.targetSize = le64toh(header.targetSize);
+
+        if ((fstat(srcFd, &st) != 0) || ((uint64_t) st.st_size != header.sourceSize) ||
+            (strncasecmp(header.sourceSha256, sourceDigest.c_str(), sizeof(header.sourceSha256)) != 0)) {
+                cout << "Delta was built against a different app data image" << endl;
+                return false;
+        }
+
+        // the target is only touched once the delta is known to fit
+        dstFd = ::open(targetPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (dstFd < 0) {
+                cout << "Error opening " << targetPath << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        haveHeader = true;
+
+        return true;
+}
+
+void DeltaPatcher::mark(uint64_t offset, uint64_t length) {
+        if ((changedRanges.empty() != true) && (changedRanges.back().first + changedRanges.back().second == offset)) {
+                changedRanges.back().second += length;
+        } else if (length > 0) {
+                changedRanges.emplace_back(offset, length);
+        }
+}
+
+bool DeltaPatcher::output(const char *data, size_t size) {
+        if (dstOffset + size > header.targetSize) {
+                cout << "Delta writes past the end of the target image" << endl;
+                return false;
+        }
+
+        while (size > 0) {
+                ssize_t ret = pwrite(dstFd, data, size, dstOffset);
+
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        cout << "Error writing " << targetPath << ": " << strerror(errno) << endl;
+                        return false;
+                }
+
+                data += ret;
+                size -= ret;
+                dstOffset += ret;
+        }
+
+        return true;
+}
+
+bool DeltaPatcher::copy(uint64_t offset, uint64_t length) {
+        if ((offset > header.sourceSize) || (length > header.sourceSize - offset)) {
+                cout << "Delta copies past the end of the source image" << endl;
+                return false;
+        }
+
+        // a block copied to where it already was is unchanged
+        if (offset != dstOffset) {
+                mark(dstOffset, length);
+        }
+
+        while (length > 0) {
+                size_t len = std::min((uint64_t) copyBuf.size(), length);
+                ssize_t ret = pread(srcFd, copyBuf.data(), len, offset);
+
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        cout << "Error reading source image: " << strerror(errno) << endl;
+                        return false;
+                }
+
+                if (ret == 0) {
+                        cout << "Source image is shorter than expected" << endl;
+                        return false;
+                }
+
+                if (output(copyBuf.data(), ret) != true) {
+                        return false;
+                }
+
+                offset += ret;
+                length -= ret;
+                numCopied += ret;
+        }
+
+        return true;
+}
+
+bool DeltaPatcher::write(const char *data, size_t size) {
+        if ((failed == true) || (srcFd < 0)) {
+                return false;
+        }
+
+        while (size > 0) {
+                if (done == true) {
+                        cout << "Trailing data after the end of the delta" << endl;
+                        failed = true;
+                        return false;
+                }
+
+                if (literalLeft > 0) {
+                        size_t len = std::min(literalLeft, (uint64_t) size);
+
+                        mark(dstOffset, len);
+
+                        if (output(data, len) != true) {
+                                failed = true;
+                                return false;
+                        }
+
+                        data += len;
+                        size -= len;
+                        literalLeft -= len;
+                        numLiteral += len;
+                        continue;
+                }
+
+                // headers and ops may be split across writes, collect them
+                size_t need = haveHeader ? (pending.empty() ? 1 : opSize(pending[0])) : sizeof(header);
+                size_t len = std::min(need - pending.size(), size);
+
+                pending.insert(pending.end(), data, data + len);
+                data += len;
+                size -= len;
+
+                if (haveHeader == true) {
+                        need = opSize(pending[0]);
+
+                        if (need == 0) {
+                                cout << "Unknown delta operation " << (int) pending[0] << endl;
+                                failed = true;
+                                return false;
+                        }
+                }
+
+                if (pending.size() < need) {
+                        continue;
+                }
+
+                bool ok = true;
+
+                if (haveHeader != true) {
+                        ok = parseHeader();
+                } else if (pending[0] == DELTA_COPY) {
+                        ok = copy(getLe64(&pending[1]), getLe64(&pending[9]));
+                } else if (pending[0] == DELTA_DATA) {
+                        literalLeft = getLe64(&pending[1]);
+                } else {
+                        done = true;
+                }
+
+                pending.clear();
+
+                if (ok != true) {
+                        failed = true;
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+bool DeltaPatcher::finish(void) {
+        if ((failed == true) || (done != true) || (dstOffset != header.targetSize)) {
+                cout << "Delta is incomplete, " << dstOffset << " of " << header.targetSize << " bytes written" << endl;
+                close();
+                return false;
+        }
+
+        if (fsync(dstFd) != 0) {
+                cout << "Error syncing " << targetPath << ": " << strerror(errno) << endl;
+                close();
+                return false;
+        }
+
+        close();
+
+        return true;
+}
+
+std::string DeltaPatcher::targetSha256(void) const {
+        return std::string(header.targetSha256, sizeof(header.targetSha256));
+}
+
+bool DeltaPatcher::apply(const std::string& delta, const std::string& source, const std::string& target, const std::string& sourceSha256) {
+        std::vector<char> buf(DELTA_CHUNK_SIZE);
+        int fd = ::open(delta.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                cout << "Error opening " << delta << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (open(source, target, sourceSha256) != true) {
+                ::close(fd);
+                return false;
+        }
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        while (true) {
+                ssize_t ret = read(fd, buf.data(), buf.size());
+
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        cout << "Error reading " << delta << ": " << strerror(errno) << endl;
+                        ::close(fd);
+                        close();
+                        return false;
+                }
+
+                if (ret == 0) {
+                        break;
+                }
+
+                if (write(buf.data(), ret) != true) {
+                        ::close(fd);
+                        close();
+                        return false;
+                }
+        }
+
+        ::close(fd);
+
+        return finish();
+}
+
+/*
+ * rsync style weak checksum, cheap to roll forward by one byte.
+ */
+typedef struct rollsum_t {
+        uint32_t a;
+        uint32_t b;
+        size_t len;
+
+        void init(const unsigned char *p, size_t n) {
+                a = 0;
+                b = 0;
+                len = n;
+                for (size_t i = 0; i < n; i++) {
+                        a += p[i];
+                        b += (n - i) * p[i];
+                }
+        }
+
+        void roll(unsigned char out, unsigned char in) {
+                a += in - out;
+                b += a - len * out;
+        }
+
+        uint32_t digest(void) const {
+                return (a & 0xffff) | (b << 16);
+        }
+} rollsum_t;
+
+class MappedFile {
+public:
+        explicit MappedFile(const std::string& path) {
+                struct stat st;
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+                if (fd < 0) {
+                        cout << "Error opening " << path << ": " << strerror(errno) << endl;
+                        return;
+                }
+
+                if (fstat(fd, &st) == 0) {
+                        size = st.st_size;
+                        if (size == 0) {
+                                ok = true;
+                        } else {
+                                void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                                if (p != MAP_FAILED) {
+                                        data = (const unsigned char*) p;
+                                        ok = true;
+                                }
+                        }
+                }
+
+                if (ok != true) {
+                        cout << "Error mapping " << path << ": " << strerror(errno) << endl;
+                }
+
+                ::close(fd);
+        }
+
+        ~MappedFile() {
+                if (data) {
+                        munmap((void*) data, size);
+                }
+        }
+
+        const unsigned char *data = NULL;
+        size_t size = 0;
+        bool ok = false;
+};
+
+static void putLe64(std::ofstream& out, uint64_t v) {
+        v = htole64(v);
+        out.write((const char*) &v, sizeof(v));
+}
+
+DeltaBuilder::DeltaBuilder(size_t blockSize) {
+        blkSize = std::max((size_t) 64, blockSize);
+        numCopied = 0;
+        numLiteral = 0;
+        numDelta = 0;
+}
+
+bool DeltaBuilder::build(const std::string& source, const std::string& target, const std::string& delta) {
+        MappedFile src(source);
+        MappedFile dst(target);
+        HashEngine engine(HASH_FLAT);
+        std::string digest;
+
+        numCopied = 0;
+        numLiteral = 0;
+        numDelta = 0;
+        sourceDigest.clear();
+
+        if ((src.ok != true) || (dst.ok != true) || (engine.hashFile(target, digest) != true) ||
+            (engine.hashFile(source, sourceDigest) != true)) {
+                return false;
+        }
+
+        std::ofstream out(delta, std::ios::binary | std::ios::trunc);
+
+        if (!out.is_open()) {
+                cout << "Error opening " << delta << endl;
+                return false;
+        }
+
+        deltaHeader_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+        header.version = htole32(DELTA_VERSION);
+        header.blockSize = htole32(blkSize);
+        header.sourceSize = htole64(src.size);
+        header.targetSize = htole64(dst.size);
+        memcpy(header.targetSha256, digest.c_str(), std::min(digest.size(), sizeof(header.targetSha256)));
+        memcpy(header.sourceSha256, sourceDigest.c_str(), std::min(sourceDigest.size(), sizeof(header.sourceSha256)));
+        out.write((const char*) &header, sizeof(header));
+
+        // index every whole source block by its weak checksum
+        size_t srcBlocks = src.size / blkSize;
+        std::vector<uint32_t> weak(srcBlocks);
+        std::unordered_map<uint32_t, std::vector<size_t>> index;
+
+        for (size_t i = 0; i < srcBlocks; i++) {
+                rollsum_t sum;
+                sum.init(src.data + i * blkSize, blkSize);
+                weak[i] = sum.digest();
+                index[weak[i]].push_back(i);
+        }
+
+        uint64_t copyOffset = 0;
+        uint64_t copyLength = 0;
+        size_t literalStart = 0;
+
+        auto flushCopy = [&]() {
+                if (copyLength > 0) {
+                        out.put(DELTA_COPY);
+                        putLe64(out, copyOffset);
+                        putLe64(out, copyLength);
+                        numCopied += copyLength;
+                        copyLength = 0;
+                }
+        };
+
+        auto flushLiteral = [&](size_t end) {
+                if (end > literalStart) {
+                        flushCopy();
+                        out.put(DELTA_DATA);
+                        putLe64(out, end - literalStart);
+                        out.write((const char*) dst.data + literalStart, end - literalStart);
+                        numLiteral += end - literalStart;
+                }
+        };
+
+        auto match = [&](size_t block, size_t pos) {
+                return memcmp(src.data + block * blkSize, dst.data + pos, blkSize) == 0;
+        };
+
+        size_t pos = 0;
+        rollsum_t sum;
+
+        if (dst.size >= blkSize) {
+                sum.init(dst.data, blkSize);
+        }
+
+        while ((srcBlocks > 0) && (pos + blkSize <= dst.size)) {
+                uint32_t d = sum.digest();
+                ssize_t found = -1;
+
+                // continuing the current copy keeps the op list short, try
+                // the next source block first
+                size_t follow = (copyOffset + copyLength) / blkSize;
+
+                if ((copyLength > 0) && ((copyOffset + copyLength) % blkSize == 0) && (follow < srcBlocks) &&
+                    (weak[follow] == d) && match(follow, pos)) {
+                        found = follow;
+                } else {
+                        auto it = index.find(d);
+
+                        if (it != index.end()) {
+                                size_t tries = 0;
+
+                                for (size_t block : it->second) {
+                                        if (tries++ == DELTA_MAX_CANDIDATES) {
+                                                break;
+                                        }
+                                        if (match(block, pos)) {
+                                                found = block;
+                                                break;
+                                        }
+                                }
+                        }
+                }
+
+                if (found >= 0) {
+                        flushLiteral(pos);
+
+                        if ((copyLength > 0) && (copyOffset + copyLength == found * blkSize)) {
+                                copyLength += blkSize;
+                        } else {
+                                flushCopy();
+                                copyOffset = found * blkSize;
+                                copyLength = blkSize;
+                        }
+
+                        pos += blkSize;
+                        literalStart = pos;
+
+                        if (pos + blkSize <= dst.size) {
+                                sum.init(dst.data + pos, blkSize);
+                        }
+                        continue;
+                }
+
+                if (pos + blkSize < dst.size) {
+                        sum.roll(dst.data[pos], dst.data[pos + blkSize]);
+                }
+                pos++;
+        }
+
+        flushLiteral(dst.size);
+        flushCopy();
+        out.put(DELTA_END);
+
+        numDelta = out.tellp();
+        out.close();
+
+        if (!out) {
+                cout << "Error writing " << delta << endl;
+                return false;
+        }
+
+        return true;
+}
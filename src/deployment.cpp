@@ -0,0 +1,648 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// SHA256_CTX is a plain struct that can be saved in the download journal,
+// EVP_MD_CTX is opaque and cannot be serialized
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "deployment.h"
+
+using namespace std;
+
+typedef struct journal_t {
+        uint32_t magic;
+        uint32_t ctxSize;
+        char sha256[SHA256_DIGEST_LENGTH * 2 + 1];
+        uint64_t offset;
+        SHA256_CTX ctx;
+} journal_t;
+
+#define JOURNAL_MAGIC 0x45474a31        // "EGJ1"
+
+static journal_t journalFor(const std::string& expected, uint64_t offset, const SHA256_CTX& ctx) {
+        journal_t journal;
+
+        memset(&journal, 0, sizeof(journal));
+        journal.magic = JOURNAL_MAGIC;
+        journal.ctxSize = sizeof(SHA256_CTX);
+        strncpy(journal.sha256, expected.c_str(), sizeof(journal.sha256) - 1);
+        journal.offset = offset;
+        journal.ctx = ctx;
+
+        return journal;
+}
+
+// syncs the artifact and then replaces the journal, called on the event loop
+// or on the journal worker
+static bool commitJournal(int fd, const journal_t& journal, const std::string& path) {
+        std::string tmp = path + ".tmp";
+
+        // the journal must never point past data that is on disk
+        if (fdatasync(fd) != 0) {
+                cout << "Error syncing artifact: " << strerror(errno) << endl;
+                return false;
+        }
+
+        int jfd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (jfd < 0) {
+                cout << "Error opening " << tmp << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        bool ok = (::write(jfd, &journal, sizeof(journal)) == sizeof(journal)) && (fdatasync(jfd) == 0);
+        ::close(jfd);
+
+        if ((ok != true) || (rename(tmp.c_str(), path.c_str()) != 0)) {
+                cout << "Error writing download journal" << endl;
+                unlink(tmp.c_str());
+                return false;
+        }
+
+        return true;
+}
+
+DigestSink::DigestSink() {
+        fd = -1;
+        failed = false;
+        numWritten = 0;
+        numReceived = 0;
+        resumeOffset = 0;
+        lastCheckpoint = 0;
+        chunkSize = SINK_CHUNK_MIN;
+        journalBusy = false;
+        journalFailed = false;
+}
+
+DigestSink::~DigestSink() {
+        close();
+}
+
+bool DigestSink::open(const std::string& path, const std::string& expected, bool resume) {
+        close();
+
+        if (path != filePath) {
+                numReceived = 0;
+        }
+
+        filePath = path;
+        journalPath = path + ".journal";
+        this->expected = expected;
+        failed = false;
+        journalFailed = false;
+        pending.clear();
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+        if (fd < 0) {
+                cout << "Error opening " << path << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if ((resume == true) && (loadJournal() == true)) {
+                // anything past the last checkpoint may not have hit the disk
+                if (ftruncate(fd, numWritten) != 0) {
+                        cout << "Error truncating " << path << ": " << strerror(errno) << endl;
+                        close();
+                        return false;
+                }
+                cout << "Resuming " << path << " at " << numWritten << " bytes" << endl;
+        } else if (reset() != true) {
+                close();
+                return false;
+        }
+
+        if (lseek(fd, numWritten, SEEK_SET) < 0) {
+                cout << "Error seeking " << path << ": " << strerror(errno) << endl;
+                close();
+                return false;
+        }
+
+        resumeOffset = numWritten;
+        lastCheckpoint = numWritten;
+
+        return true;
+}
+
+bool DigestSink::loadJournal(void) {
+        journal_t journal;
+        struct stat st;
+        int jfd = ::open(journalPath.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (jfd < 0) {
+                return false;
+        }
+
+        ssize_t ret = read(jfd, &journal, sizeof(journal));
+        ::close(jfd);
+
+        if ((ret != sizeof(journal)) || (journal.magic != JOURNAL_MAGIC) || (journal.ctxSize != sizeof(SHA256_CTX))) {
+                return false;
+        }
+
+        journal.sha256[sizeof(journal.sha256) - 1] = '\0';
+
+        // a journal for a different artifact with the same file name
+        if (strcasecmp(journal.sha256, expected.c_str()) != 0) {
+                return false;
+        }
+
+        if ((fstat(fd, &st) != 0) || ((uint64_t) st.st_size < journal.offset)) {
+                return false;
+        }
+
+        mdCtx = journal.ctx;
+        numWritten = journal.offset;
+
+        return true;
+}
+
+bool DigestSink::reset(void) {
+        // a journal still being written would describe the old data
+        waitJournal();
+
+        if ((ftruncate(fd, 0) != 0) || (lseek(fd, 0, SEEK_SET) < 0)) {
+                cout << "Error truncating " << filePath << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (!SHA256_Init(&mdCtx)) {
+                cout << "SHA256_Init failed" << endl;
+                return false;
+        }
+
+        numWritten = 0;
+        lastCheckpoint = 0;
+        pending.clear();
+        unlink(journalPath.c_str());
+
+        return true;
+}
+
+bool DigestSink::start(long status) {
+        if ((resumeOffset > 0) && (status != 206)) {
+                // the server ignored the Range header and sends everything
+                cout << "Server does not support resume, restarting " << filePath << endl;
+                resumeOffset = 0;
+
+                if (reset() != true) {
+                        failed = true;
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+bool DigestSink::write(const char *data, size_t size) {
+        if (journalFailed == true) {
+                failed = true;
+        }
+
+        if (failed == true) {
+                return false;
+        }
+
+        pending.append(data, size);
+        numReceived += size;
+
+        if ((pending.size() >= chunkSize) && (flush() != true)) {
+                return false;
+        }
+
+        // with the previous checkpoint still syncing a later write retries
+        if ((numWritten - lastCheckpoint >= JOURNAL_INTERVAL) && (journalBusy != true)) {
+                return checkpointAsync();
+        }
+
+        return true;
+}
+
+bool DigestSink::flush(void) {
+        auto start = std::chrono::steady_clock::now();
+        const char *p = pending.data();
+        size_t remaining = pending.size();
+
+        if ((fd < 0) || (remaining == 0)) {
+                return !failed;
+        }
+
+        while (remaining > 0) {
+                ssize_t ret = ::write(fd, p, remaining);
+
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        cout << "Error writing artifact: " << strerror(errno) << endl;
+                        failed = true;
+                        return false;
+                }
+
+                p += ret;
+                remaining -= ret;
+        }
+
+        if (!SHA256_Update(&mdCtx, pending.data(), pending.size())) {
+                cout << "SHA256_Update failed" << endl;
+                failed = true;
+                return false;
+        }
+
+        numWritten += pending.size();
+
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        // halve quickly when the system is busy, grow back slowly
+        if (us > SINK_CHUNK_BUDGET_US) {
+                chunkSize = std::max(chunkSize / 2, (size_t) SINK_CHUNK_MIN);
+        } else if ((us < SINK_CHUNK_BUDGET_US / 4) && (pending.size() >= chunkSize)) {
+                chunkSize = std::min(chunkSize * 2, (size_t) SINK_CHUNK_MAX);
+        }
+
+        pending.clear();
+
+        return true;
+}
+
+bool DigestSink::checkpoint(void) {
+        waitJournal();
+
+        if (journalFailed == true) {
+                failed = true;
+        }
+
+        if (flush() != true) {
+                return false;
+        }
+
+        // the file and the digest state disagree after a failed write
+        if ((fd < 0) || (failed == true) || (numWritten == lastCheckpoint)) {
+                return !failed;
+        }
+
+        if (commitJournal(fd, journalFor(expected, numWritten, mdCtx), journalPath) != true) {
+                return false;
+        }
+
+        lastCheckpoint = numWritten;
+
+        return true;
+}
+
+bool DigestSink::checkpointAsync(void) {
+        if (flush() != true) {
+                return false;
+        }
+
+        if ((fd < 0) || (failed == true)) {
+                return !failed;
+        }
+
+        journal_t journal = journalFor(expected, numWritten, mdCtx);
+
+        // the last worker is done, this only reaps it
+        waitJournal();
+
+        journalBusy = true;
+        lastCheckpoint = numWritten;
+
+        // the sync also covers whatever is written in the meantime, the
+        // journal only claims what was written up to here
+        journalWorker = std::thread([this, journal]() {
+                if (commitJournal(fd, journal, journalPath) != true) {
+                        journalFailed = true;
+                }
+
+                journalBusy = false;
+        });
+
+        return true;
+}
+
+void DigestSink::waitJournal(void) {
+        if (journalWorker.joinable()) {
+                journalWorker.join();
+        }
+}
+
+bool DigestSink::finish(std::string& digest) {
+        unsigned char md[SHA256_DIGEST_LENGTH];
+        std::stringstream hash;
+
+        if ((flush() != true) || (failed == true)) {
+                close();
+                return false;
+        }
+
+        if (!SHA256_Final(md, &mdCtx)) {
+                cout << "SHA256_Final failed" << endl;
+                close();
+                return false;
+        }
+
+        if (fsync(fd) != 0) {
+                cout << "Error syncing artifact: " << strerror(errno) << endl;
+                close();
+                return false;
+        }
+
+        close();
+        unlink(journalPath.c_str());
+
+        hash << std::hex << std::setfill('0');
+
+        for (const auto &c: md) {
+                hash << std::setw(2) << (int)c;
+        }
+
+        digest = hash.str();
+
+        return true;
+}
+
+void DigestSink::close(void) {
+        waitJournal();
+
+        if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+        }
+}
+
+void DigestSink::discard(void) {
+        close();
+        unlink(filePath.c_str());
+        unlink(journalPath.c_str());
+}
+
+DeploymentFetcher::DeploymentFetcher(HTTP& http, std::string downloadDir) : http(http), downloadDir(downloadDir) {
+        next = 0;
+        attempts = 0;
+        inProgress = false;
+        slotWriter = NULL;
+        slotInstalled = false;
+}
+
+std::string DeploymentFetcher::path(const artifact_t& artifact) const {
+        // never let the server pick a path outside of the download directory
+        // and store compressed artifacts as they are unpacked
+        return (std::filesystem::path(downloadDir) / std::filesystem::path(Decompressor::strip(artifact.filename)).filename()).string();
+}
+
+void DeploymentFetcher::fetch(const std::string& deploymentBase, const std::string& sslkey, const std::string& sslcert, Completion done) {
+        if (inProgress == true) {
+                cout << "Deployment download already in progress" << endl;
+                return;
+        }
+
+        inProgress = true;
+        slotInstalled = false;
+        this->sslkey = sslkey;
+        this->sslcert = sslcert;
+        this->done = done;
+
+        http.get(deploymentBase, sslkey, sslcert, [this](bool ok, long status, std::string_view res) {
+                if ((ok != true) || (status != 200) || (parseDeployment(res) != true)) {
+                        cout << "Error getting deployment details from server" << endl;
+                        complete(false);
+                        return;
+                }
+
+                std::error_code ec;
+                std::filesystem::create_directories(downloadDir, ec);
+
+                next = 0;
+                fetchNext();
+        });
+}
+
+bool DeploymentFetcher::parseDeployment(std::string_view res) {
+        ddiDeployment_t deployment;
+        ddiError_t err = ddiParseDeployment(res, deployment);
+
+        if (err != DDI_OK) {
+                cout << "Error parsing deployment: " << ddiErrorString(err) << endl;
+                artifactList.clear();
+                return false;
+        }
+
+        artifactList = std::move(deployment.artifacts);
+
+        return true;
+}
+
+void DeploymentFetcher::fetchNext(void) {
+        if (next == artifactList.size()) {
+                complete(true);
+                return;
+        }
+
+        attempts = 0;
+
+        if ((slotWriter != NULL) && (slotDevice.empty() != true) && Decompressor::strip(artifactList.at(next).filename).ends_with(INSTALL_SUFFIX)) {
+                installSlot();
+        } else {
+                download();
+        }
+}
+
+void DeploymentFetcher::download(void) {
+        const artifact_t& artifact = artifactList.at(next);
+        compression_t compression = Decompressor::detect(artifact.filename);
+
+        // the decoder state can't be journaled, unpacking always starts over
+        if (sink.open(path(artifact), artifact.sha256, compression == COMPRESSION_NONE) != true) {
+                complete(false);
+                return;
+        }
+
+        if ((compression != COMPRESSION_NONE) && (unpack.open(compression, &sink) != true)) {
+                sink.discard();
+                complete(false);
+                return;
+        }
+
+        attempts++;
+
+        auto verify = [this, compression](bool ok, long status, std::string_view res) {
+                const artifact_t& artifact = artifactList.at(next);
+                std::string digest, packed;
+
+                if (ok != true) {
+                        // keep what was received for the next attempt
+                        sink.checkpoint();
+                        sink.close();
+
+                        if ((status == 416) || (compression != COMPRESSION_NONE)) {
+                                unpack.close();
+                                sink.discard();
+                        }
+
+                        if (attempts < DOWNLOAD_RETRIES) {
+                                cout << "Error downloading " << artifact.filename << ", retrying from " << sink.written() << " bytes" << endl;
+                                download();
+                        } else {
+                                cout << "Error downloading " << artifact.filename << endl;
+                                complete(false);
+                        }
+                        return;
+                }
+
+                if (((compression != COMPRESSION_NONE) && (unpack.finish(packed) != true)) || (sink.finish(digest) != true) ||
+                    (check(artifact, packed, digest) != true)) {
+                        sink.discard();
+                        complete(false);
+                        return;
+                }
+
+                if (compression != COMPRESSION_NONE) {
+                        cout << "Verified " << artifact.filename << " (" << unpack.in() << " bytes, " << sink.written() << " unpacked)" << endl;
+                } else {
+                        cout << "Verified " << artifact.filename << " (" << sink.written() << " bytes, " << sink.received() << " received)" << endl;
+                }
+
+                next++;
+                fetchNext();
+        };
+
+        // everything was received before the interruption, only the
+        // final digest is missing
+        if ((artifact.size > 0) && (sink.offset() == artifact.size)) {
+                verify(true, 206, std::string());
+                return;
+        }
+
+        cout << "Downloading " << artifact.filename << " (" << artifact.size << " bytes) from offset " << sink.offset() << endl;
+
+        http.download(artifact.href, sslkey, sslcert, (compression != COMPRESSION_NONE) ? (HTTPSink*) &unpack : &sink, verify, sink.offset());
+}
+
+void DeploymentFetcher::installSlot(void) {
+        const artifact_t& artifact = artifactList.at(next);
+        compression_t compression = Decompressor::detect(artifact.filename);
+        // a UBI volume update has to know the unpacked size up front
+        size_t size = (compression != COMPRESSION_NONE) ? artifact.unpackedSize : artifact.size;
+        const std::string& expected = (compression != COMPRESSION_NONE) ? artifact.unpackedSha256 : artifact.sha256;
+
+        // the read back only proves the slot holds what was received, a
+        // stream cut short has to be caught by its size or digest
+        if ((size == 0) && expected.empty()) {
+                cout << "Not installing " << artifact.filename << ", neither its size nor its digest is known" << endl;
+                complete(false);
+                return;
+        }
+
+        if (slotWriter->open(slotDevice, size, [this](bool pause) { http.pauseDownload(pause); }) != true) {
+                complete(false);
+                return;
+        }
+
+        if ((compression != COMPRESSION_NONE) && (unpack.open(compression, slotWriter) != true)) {
+                slotWriter->abort();
+                complete(false);
+                return;
+        }
+
+        attempts++;
+
+        cout << "Installing " << artifact.filename << " (" << artifact.size << " bytes, " << Decompressor::name(compression)
+             << " compression) into " << slotDevice << endl;
+
+        HTTPSink *target = (compression != COMPRESSION_NONE) ? (HTTPSink*) &unpack : slotWriter;
+
+        http.download(artifact.href, sslkey, sslcert, target, [this, compression](bool ok, long status, std::string_view res) {
+                const artifact_t& artifact = artifactList.at(next);
+                std::string packed;
+
+                // the decoder hands out its last data only now, and the
+                // writer may still hold some back from when it paused the
+                // download; all of it has to be queued before finishing
+                if ((ok == true) && (((compression != COMPRESSION_NONE) && (unpack.finish(packed) != true)) || (slotWriter->flush() != true))) {
+                        slotWriter->abort();
+                        complete(false);
+                        return;
+                }
+
+                if (ok != true) {
+                        // a half written slot is not worth keeping, start over
+                        unpack.close();
+                        slotWriter->abort();
+
+                        if (attempts < DOWNLOAD_RETRIES) {
+                                cout << "Error downloading " << artifact.filename << ", installing again" << endl;
+                                installSlot();
+                        } else {
+                                cout << "Error downloading " << artifact.filename << endl;
+                                complete(false);
+                        }
+                        return;
+                }
+
+                slotWriter->finish([this, packed](bool ok, std::string digest) {
+                        const artifact_t& artifact = artifactList.at(next);
+
+                        if (ok != true) {
+                                cout << "Error installing " << artifact.filename << " into " << slotDevice << endl;
+                                complete(false);
+                                return;
+                        }
+
+                        if (check(artifact, packed, digest) != true) {
+                                complete(false);
+                                return;
+                        }
+
+                        cout << "Installed and verified " << artifact.filename << " (" << slotWriter->written() << " bytes, download paused "
+                             << slotWriter->stalls() << " times for the writer)" << endl;
+
+                        slotInstalled = true;
+                        next++;
+                        fetchNext();
+                });
+        });
+}
+
+bool DeploymentFetcher::check(const artifact_t& artifact, const std::string& packed, const std::string& unpacked) {
+        // the server's digest is of the file as it was uploaded
+        const std::string& received = packed.empty() ? unpacked : packed;
+
+        if (strcasecmp(received.c_str(), artifact.sha256.c_str()) != 0) {
+                cout << "SHA-256 mismatch for " << artifact.filename << ": got " << received << ", expected " << artifact.sha256 << endl;
+                return false;
+        }
+
+        if ((packed.empty() != true) && (artifact.unpackedSha256.empty() != true) &&
+            (strcasecmp(unpacked.c_str(), artifact.unpackedSha256.c_str()) != 0)) {
+                cout << "SHA-256 mismatch for unpacked " << artifact.filename << ": got " << unpacked << ", expected " << artifact.unpackedSha256 << endl;
+                return false;
+        }
+
+        return true;
+}
+
+void DeploymentFetcher::complete(bool ok) {
+        Completion cb = std::move(done);
+
+        inProgress = false;
+
+        if (cb) {
+                cb(ok);
+        }
+}
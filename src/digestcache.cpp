@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include "digestcache.h"
+#include "hash.h"
+
+using namespace std;
+
+DigestCache::DigestCache(std::string path, bool sample) : cachePath(path), sampleBlocks(sample) {
+}
+
+bool DigestCache::identify(const std::string& file, fileIdentity_t& id) {
+        struct stat st;
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                return false;
+        }
+
+        if (fstat(fd, &st) != 0) {
+                close(fd);
+                return false;
+        }
+
+        id.dev = st.st_dev;
+        id.ino = st.st_ino;
+        id.size = st.st_size;
+        id.mtimeSec = st.st_mtim.tv_sec;
+        id.mtimeNsec = st.st_mtim.tv_nsec;
+        id.ctimeSec = st.st_ctim.tv_sec;
+        id.ctimeNsec = st.st_ctim.tv_nsec;
+        id.sample.clear();
+
+        if (sampleBlocks == true) {
+                // first, middle and last block, catches writes that kept
+                // the timestamps, e.g. a restored image or a raw dd
+                unsigned char buf[DIGEST_CACHE_SAMPLE_SIZE];
+                unsigned char md[SHA256_DIGEST_LENGTH];
+                unsigned int mdLen;
+                off_t offsets[] = {0, (off_t) (id.size / 2), (off_t) (id.size > sizeof(buf) ? id.size - sizeof(buf) : 0)};
+                EVP_MD_CTX *mdCtx = EVP_MD_CTX_new();
+                bool ok = EVP_DigestInit_ex(mdCtx, EVP_sha256(), NULL);
+
+                for (off_t offset : offsets) {
+                        ssize_t cnt = pread(fd, buf, sizeof(buf), offset);
+
+                        if ((cnt < 0) || !EVP_DigestUpdate(mdCtx, buf, cnt)) {
+                                ok = false;
+                                break;
+                        }
+                }
+
+                ok = ok && EVP_DigestFinal_ex(mdCtx, md, &mdLen);
+                EVP_MD_CTX_free(mdCtx);
+
+                if (ok != true) {
+                        close(fd);
+                        return false;
+                }
+
+                id.sample = HashEngine::toHex(md, mdLen);
+        }
+
+        close(fd);
+
+        return true;
+}
+
+std::string DigestCache::entry(const std::string& file, const std::string& tag, const fileIdentity_t& id) {
+        std::stringstream ss;
+
+        ss << "file=" << file << endl
+           << "tag=" << tag << endl
+           << "dev=" << id.dev << endl
+           << "ino=" << id.ino << endl
+           << "size=" << id.size << endl
+           << "mtime=" << id.mtimeSec << "." << id.mtimeNsec << endl
+           << "ctime=" << id.ctimeSec << "." << id.ctimeNsec << endl
+           << "sample=" << id.sample << endl;
+
+        return ss.str();
+}
+
+bool DigestCache::lookup(const std::string& file, const std::string& tag, std::string& digest) {
+        fileIdentity_t id;
+        std::string line;
+        std::stringstream key;
+
+        if (cachePath.empty() || (identify(file, id) != true)) {
+                return false;
+        }
+
+        std::ifstream cache(cachePath);
+
+        if (!cache.is_open()) {
+                return false;
+        }
+
+        // everything but the digest has to match byte for byte
+        while (std::getline(cache, line)) {
+                if (line.starts_with("digest=")) {
+                        if (key.str() != entry(file, tag, id)) {
+                                return false;
+                        }
+
+                        digest = line.substr(std::string("digest=").size());
+                        return !digest.empty();
+                }
+
+                key << line << endl;
+        }
+
+        return false;
+}
+
+bool DigestCache::store(const std::string& file, const std::string& tag, const fileIdentity_t& id, const std::string& digest) {
+        fileIdentity_t now;
+        std::string tmp = cachePath + ".tmp";
+
+        if (cachePath.empty() || (identify(file, now) != true)) {
+                return false;
+        }
+
+        if (entry(file, tag, id) != entry(file, tag, now)) {
+                cout << file << " changed while it was hashed, not caching its digest" << endl;
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), ec);
+
+        std::string data = entry(file, tag, id) + "digest=" + digest + "\n";
+
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (fd < 0) {
+                cout << "Error opening " << tmp << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        bool ok = (write(fd, data.c_str(), data.size()) == (ssize_t) data.size()) && (fsync(fd) == 0);
+        close(fd);
+
+        if ((ok != true) || (rename(tmp.c_str(), cachePath.c_str()) != 0)) {
+                cout << "Error writing digest cache " << cachePath << endl;
+                unlink(tmp.c_str());
+                return false;
+        }
+
+        return true;
+}
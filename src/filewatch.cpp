@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "filewatch.h"
+
+using namespace std;
+
+FileWatch::FileWatch(asio::io_context& io) : io(io), settle(io) {
+}
+
+FileWatch::~FileWatch() {
+        settle.cancel();
+}
+
+bool FileWatch::add(const std::string& file) {
+        if (events == nullptr) {
+                int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+                if (fd < 0) {
+                        cout << "Error creating inotify instance" << endl;
+                        return false;
+                }
+
+                events = std::make_unique<asio::posix::stream_descriptor>(io, fd);
+                wait();
+        }
+
+        return watch(std::filesystem::absolute(file).lexically_normal());
+}
+
+bool FileWatch::watch(const std::string& file) {
+        std::filesystem::path dir = std::filesystem::path(file).parent_path();
+
+        // adding a directory twice returns the same watch
+        int wd = inotify_add_watch(events->native_handle(), dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+        if (wd >= 0) {
+                dirs[wd] = dir;
+                files.insert(file);
+                pending.erase(file);
+                return true;
+        }
+
+        // wait for the missing directories to be created, one level at a
+        // time
+        while ((errno == ENOENT) && (dir.has_relative_path() == true)) {
+                dir = dir.parent_path();
+                wd = inotify_add_watch(events->native_handle(), dir.c_str(), IN_MOVED_TO | IN_CREATE);
+
+                if (wd >= 0) {
+                        dirs[wd] = dir;
+                        pending.insert(file);
+                        return true;
+                }
+        }
+
+        cout << "Error watching " << std::filesystem::path(file).parent_path().string() << ": " << strerror(errno) << endl;
+
+        return false;
+}
+
+void FileWatch::clear(void) {
+        if (events != nullptr) {
+                for (const auto& dir : dirs) {
+                        inotify_rm_watch(events->native_handle(), dir.first);
+                }
+        }
+
+        dirs.clear();
+        files.clear();
+        pending.clear();
+        settle.cancel();
+}
+
+void FileWatch::wait(void) {
+        events->async_wait(asio::posix::stream_descriptor::wait_read, [this](const asio::error_code& ec) {
+                if (ec) {
+                        return;
+                }
+
+                alignas(struct inotify_event) char buf[4096];
+                std::set<std::string> created;
+                bool ours = false;
+                ssize_t len;
+
+                while ((len = read(events->native_handle(), buf, sizeof(buf))) > 0) {
+                        for (char *p = buf; p < buf + len; ) {
+                                struct inotify_event *ev = (struct inotify_event *) p;
+                                auto dir = dirs.find(ev->wd);
+
+                                // after an overflow anything may have changed
+                                if (ev->mask & IN_Q_OVERFLOW) {
+                                        ours = true;
+                                } else if ((ev->len > 0) && (dir != dirs.end()) && files.contains(dir->second + "/" + ev->name)) {
+                                        ours = true;
+                                } else if ((ev->len > 0) && (dir != dirs.end()) && (ev->mask & IN_ISDIR)) {
+                                        created.insert(dir->second + "/" + ev->name + "/");
+                                }
+
+                                p += sizeof(struct inotify_event) + ev->len;
+                        }
+                }
+
+                // a directory on the way to a pending file appeared, the
+                // file may already be in it by the time it is watched
+                for (const auto& file : std::set<std::string>(pending)) {
+                        for (const auto& dir : created) {
+                                if (file.starts_with(dir) && (watch(file) == true) && files.contains(file)) {
+                                        ours = true;
+                                        break;
+                                }
+                        }
+                }
+
+                if ((ours == true) && (files.empty() != true)) {
+                        settle.expires_after(std::chrono::milliseconds(FILEWATCH_SETTLE_MS));
+                        settle.async_wait([this](const asio::error_code& ec) {
+                                if (!ec && changedHandler) {
+                                        changedHandler();
+                                }
+                        });
+                }
+
+                wait();
+        });
+}
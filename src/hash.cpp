@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include "hash.h"
+
+using namespace std;
+
+static unsigned char *allocBlock(size_t size) {
+        void *buf = NULL;
+
+        if (posix_memalign(&buf, HASH_BLOCK_ALIGN, size) != 0) {
+                return NULL;
+        }
+
+        return (unsigned char*) buf;
+}
+
+static ssize_t readFull(int fd, unsigned char *buf, size_t size, off_t offset) {
+        size_t done = 0;
+
+        while (done < size) {
+                ssize_t ret = pread(fd, buf + done, size - done, offset + done);
+
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+
+                if (ret == 0) {
+                        break;
+                }
+
+                done += ret;
+        }
+
+        return done;
+}
+
+HashEngine::HashEngine(hashMode_t mode, size_t blockSize, size_t threads) {
+        hashMode = mode;
+
+        // keep reads page aligned so the kernel can hand out whole pages
+        blkSize = std::max((size_t) HASH_BLOCK_ALIGN, (blockSize + HASH_BLOCK_ALIGN - 1) & ~((size_t) HASH_BLOCK_ALIGN - 1));
+
+        numThreads = threads;
+        if (numThreads == 0) {
+                numThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        numBytes = 0;
+        elapsed = 0;
+}
+
+bool HashEngine::parseMode(const std::string& name, hashMode_t& mode) {
+        if (name == "flat") {
+                mode = HASH_FLAT;
+        } else if (name == "tree") {
+                mode = HASH_TREE;
+        } else {
+                return false;
+        }
+
+        return true;
+}
+
+std::string HashEngine::modeName(hashMode_t mode) {
+        return (mode == HASH_TREE) ? "tree" : "flat";
+}
+
+std::string HashEngine::toHex(const unsigned char *md, size_t len) {
+        std::stringstream hash;
+
+        hash << std::hex << std::uppercase << std::setfill('0');
+
+        for (size_t i = 0; i < len; i++) {
+                hash << std::setw(2) << (int)md[i];
+        }
+
+        return hash.str();
+}
+
+double HashEngine::throughput(void) const {
+        if (elapsed <= 0) {
+                return 0;
+        }
+
+        return (numBytes / (1024.0 * 1024.0)) / elapsed;
+}
+
+bool HashEngine::hashFile(const std::string& file, std::string& digest, std::atomic<size_t> *progress) {
+        unsigned char md[SHA256_DIGEST_LENGTH];
+        struct stat st;
+        bool ok;
+
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                cout << "Error opening " << file << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (fstat(fd, &st) != 0) {
+                cout << "Error reading size of " << file << ": " << strerror(errno) << endl;
+                close(fd);
+                return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        if (hashMode == HASH_TREE) {
+                ok = hashTree(fd, st.st_size, md, progress);
+        } else {
+                ok = hashFlat(fd, st.st_size, md, progress);
+        }
+
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        numBytes = st.st_size;
+
+        close(fd);
+
+        if (ok == true) {
+                digest = toHex(md, sizeof(md));
+        }
+
+        return ok;
+}
+
+bool HashEngine::hashFlat(int fd, size_t size, unsigned char *md, std::atomic<size_t> *progress, unsigned char *digests) {
+        std::unique_ptr<unsigned char, decltype(&free)> buf(allocBlock(blkSize), &free);
+        EVP_MD_CTX *mdCtx;
+        unsigned int len;
+
+        if (!buf) {
+                cout << "Error allocating hash buffer" << endl;
+                return false;
+        }
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        mdCtx = EVP_MD_CTX_new();
+        if (!EVP_DigestInit_ex(mdCtx, EVP_sha256(), NULL)) {
+                cout << "EVP_DigestInit failed" << endl;
+                EVP_MD_CTX_free(mdCtx);
+                return false;
+        }
+
+        for (size_t offset = 0; offset < size; offset += blkSize) {
+                // start reading the next block while this one is hashed
+                posix_fadvise(fd, offset + blkSize, blkSize, POSIX_FADV_WILLNEED);
+
+                ssize_t cnt = readFull(fd, buf.get(), std::min(blkSize, size - offset), offset);
+
+                if (cnt < 0) {
+                        cout << "Error reading app data: " << strerror(errno) << endl;
+                        EVP_MD_CTX_free(mdCtx);
+                        return false;
+                }
+
+                if (!EVP_DigestUpdate(mdCtx, buf.get(), cnt)) {
+                        cout << "EVP_DigestUpdate failed" << endl;
+                        EVP_MD_CTX_free(mdCtx);
+                        return false;
+                }
+
+                // every read is one block, its digest costs no extra I/O
+                if ((digests != NULL) && !EVP_Digest(buf.get(), cnt, &digests[(offset / blkSize) * SHA256_DIGEST_LENGTH], &len, EVP_sha256(), NULL)) {
+                        cout << "EVP_Digest failed" << endl;
+                        EVP_MD_CTX_free(mdCtx);
+                        return false;
+                }
+
+                // the data is not needed again, don't let it push out the
+                // page cache of the running application
+                posix_fadvise(fd, offset, cnt, POSIX_FADV_DONTNEED);
+
+                if (progress) {
+                        *progress += cnt;
+                }
+        }
+
+        if (!EVP_DigestFinal_ex(mdCtx, md, &len)) {
+                cout << "EVP_DigestFinal failed" << endl;
+                EVP_MD_CTX_free(mdCtx);
+                return false;
+        }
+
+        EVP_MD_CTX_free(mdCtx);
+
+        return true;
+}
+
+bool HashEngine::hashBlock(int fd, size_t block, size_t size, unsigned char *buf, unsigned char *md) {
+        off_t offset = (off_t) block * blkSize;
+        size_t len = std::min(blkSize, size - offset);
+        unsigned int mdLen;
+
+        posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+
+        ssize_t cnt = readFull(fd, buf, len, offset);
+
+        if (cnt != (ssize_t) len) {
+                return false;
+        }
+
+        if (!EVP_Digest(buf, cnt, md, &mdLen, EVP_sha256(), NULL)) {
+                return false;
+        }
+
+        posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+
+        return true;
+}
+
+bool HashEngine::hashBlockList(int fd, size_t size, const std::vector<size_t>& list, unsigned char *digests, std::atomic<size_t> *progress) {
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> workers;
+
+        auto worker = [&]() {
+                std::unique_ptr<unsigned char, decltype(&free)> buf(allocBlock(blkSize), &free);
+
+                if (!buf) {
+                        failed = true;
+                        return;
+                }
+
+                // blocks are handed out in order so the reads stay mostly
+                // sequential on the device
+                for (size_t i = next++; (i < list.size()) && !failed; i = next++) {
+                        size_t b = list[i];
+
+                        if (hashBlock(fd, b, size, buf.get(), &digests[b * SHA256_DIGEST_LENGTH]) != true) {
+                                failed = true;
+                        } else if (progress) {
+                                *progress += std::min(blkSize, size - b * blkSize);
+                        }
+                }
+        };
+
+        size_t n = std::min(numThreads, std::max((size_t) 1, list.size()));
+
+        for (size_t i = 1; i < n; i++) {
+                workers.emplace_back(worker);
+        }
+
+        worker();
+
+        for (auto& t : workers) {
+                t.join();
+        }
+
+        if (failed) {
+                cout << "Error hashing app data blocks" << endl;
+                return false;
+        }
+
+        return true;
+}
+
+bool HashEngine::hashTree(int fd, size_t size, unsigned char *md, std::atomic<size_t> *progress) {
+        size_t blocks = (size + blkSize - 1) / blkSize;
+        std::vector<unsigned char> digests(blocks * SHA256_DIGEST_LENGTH);
+        std::vector<size_t> list(blocks);
+
+        for (size_t b = 0; b < blocks; b++) {
+                list[b] = b;
+        }
+
+        if (hashBlockList(fd, size, list, digests.data(), progress) != true) {
+                return false;
+        }
+
+        return treeRoot(digests, md);
+}
+
+bool HashEngine::treeRoot(const std::vector<unsigned char>& digests, unsigned char *md) {
+        unsigned int mdLen;
+
+        if (!EVP_Digest(digests.data(), digests.size(), md, &mdLen, EVP_sha256(), NULL)) {
+                cout << "EVP_Digest failed" << endl;
+                return false;
+        }
+
+        return true;
+}
+
+bool HashEngine::hashBlocks(const std::string& file, const std::vector<size_t>& blocks, std::vector<unsigned char>& digests, std::atomic<size_t> *progress) {
+        struct stat st;
+        bool ok;
+
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                cout << "Error opening " << file << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (fstat(fd, &st) != 0) {
+                cout << "Error reading size of " << file << ": " << strerror(errno) << endl;
+                close(fd);
+                return false;
+        }
+
+        digests.resize(((st.st_size + blkSize - 1) / blkSize) * SHA256_DIGEST_LENGTH);
+
+        for (size_t b : blocks) {
+                if ((b + 1) * SHA256_DIGEST_LENGTH > digests.size()) {
+                        cout << "Block " << b << " is past the end of " << file << endl;
+                        close(fd);
+                        return false;
+                }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        ok = hashBlockList(fd, st.st_size, blocks, digests.data(), progress);
+
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        numBytes = std::min((size_t) st.st_size, blocks.size() * blkSize);
+
+        close(fd);
+
+        return ok;
+}
+
+bool HashEngine::hashFileBlocks(const std::string& file, std::string& digest, std::vector<unsigned char>& digests, std::atomic<size_t> *progress) {
+        unsigned char md[SHA256_DIGEST_LENGTH];
+        struct stat st;
+        bool ok;
+
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+                cout << "Error opening " << file << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (fstat(fd, &st) != 0) {
+                cout << "Error reading size of " << file << ": " << strerror(errno) << endl;
+                close(fd);
+                return false;
+        }
+
+        digests.resize(((st.st_size + blkSize - 1) / blkSize) * SHA256_DIGEST_LENGTH);
+
+        auto start = std::chrono::steady_clock::now();
+
+        ok = hashFlat(fd, st.st_size, md, progress, digests.data());
+
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        numBytes = st.st_size;
+
+        close(fd);
+
+        if (ok == true) {
+                digest = toHex(md, sizeof(md));
+        }
+
+        return ok;
+}
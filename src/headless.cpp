@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * egt-swupdate for units without a display: the same update logic as the
+ * GUI on a plain asio event loop, without creating an EGT application,
+ * window or theme and without linking libegt or cairo.
+ */
+
+#include <iostream>
+#include <csignal>
+#include <cxxopts.hpp>
+#include <curl/curl.h>
+#include "updater.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "EGT SWUpdate client without a display");
+
+	options.add_options()
+	("h,help", "Show help")
+	("f,config", "Path to swupdate config file, defaults to /etc/swupdate.cfg if no arguments specified", cxxopts::value<std::string>()->default_value("/etc/swupdate.cfg"))
+	("r,reboot-delay", "Seconds to wait before rebooting into a staged update, -1 to leave the reboot to the system", cxxopts::value<int>()->default_value("10"))
+	("v,version", "Show version");
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help")) {
+		cout << options.help() << endl;
+		return 0;
+	} else if (args.count("version")) {
+		cout << "egt-swupdate " << EGT_SWUPDATE_VERSION << endl;
+		return 0;
+	}
+
+	int rebootDelay = args["reboot-delay"].as<int>();
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	{
+		asio::io_context io;
+		asio::signal_set signals(io, SIGINT, SIGTERM);
+		asio::steady_timer rebootTimer(io);
+
+		signals.async_wait([&io](const asio::error_code& ec, int sig) {
+			if (!ec) {
+				cout << "Exiting on signal " << sig << endl;
+				io.stop();
+			}
+		});
+
+		Updater updater(io, args["config"].as<std::string>());
+
+		updater.onUpdateReady([&rebootTimer, rebootDelay]() {
+			if (rebootDelay < 0) {
+				cout << "Update staged, it is installed on the next reboot" << endl;
+				return;
+			}
+
+			cout << "Update staged, rebooting in " << rebootDelay << " s" << endl;
+
+			rebootTimer.expires_after(std::chrono::seconds(rebootDelay));
+			rebootTimer.async_wait([](const asio::error_code& ec) {
+				if (!ec) {
+					system("/usr/sbin/reboot");
+				}
+			});
+		});
+
+		updater.start();
+
+		io.run();
+	}
+
+	curl_global_cleanup();
+
+	return 0;
+}
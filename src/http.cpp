@@ -6,6 +6,7 @@
 #include <cwctype>
 #include <cstring>
 #include "http.h"
+#include "metrics.h"
 
 using namespace std;
 
@@ -30,30 +31,316 @@ int strncasecmp(std::string s1, std::string s2, ssize_t len) {
 }
 
 size_t writeCb(void *buffer, size_t size, size_t nmemb, void *userptr) {
-        string data((const char*)buffer, (size_t) size * nmemb);
+        bufferData *recv = (bufferData*) userptr;
+        size_t len = size * nmemb;
+        size_t capacity = recv->body.capacity();
 
-        *((stringstream*) userptr) << data << endl;
+        // reserve the whole body up front instead of growing chunk by chunk,
+        // the length is only a hint so a bogus one can't pin much memory
+        if (recv->sized == false) {
+                curl_off_t length = -1;
+
+                recv->sized = true;
+                curl_easy_getinfo(recv->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+
+                if (length > 0) {
+                        recv->body.reserve(std::min((size_t) length, (size_t) HTTP_BUFFER_KEEP));
+                }
+        }
+
+        recv->body.append((const char*) buffer, len);
+        recv->copied += len;
+
+        if (recv->body.capacity() != capacity) {
+                recv->allocations++;
+        }
+
+        return len;
+}
+
+size_t headerCb(char *buffer, size_t size, size_t nitems, void *userptr) {
+        validatorData *v = (validatorData*) userptr;
+        std::string line(buffer, size * nitems);
+        size_t colon = line.find(':');
+
+        if (colon == std::string::npos) {
+                return size * nitems;
+        }
+
+        std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r\n") + 1);
+
+        if (strncasecmp(name, "etag") == 1) {
+                v->etag = value;
+        } else if (strncasecmp(name, "last-modified") == 1) {
+                v->lastModified = value;
+        }
+
+        return size * nitems;
+}
+
+size_t sinkCb(void *buffer, size_t size, size_t nmemb, void *userptr) {
+        sinkData *recv = (sinkData*) userptr;
+
+        if (recv->started == false) {
+                long status = 0;
+
+                recv->started = true;
+                curl_easy_getinfo(recv->curl, CURLINFO_RESPONSE_CODE, &status);
+
+                if (recv->sink->start(status) != true) {
+                        return 0;
+                }
+        }
+
+        if (recv->sink->write((const char*) buffer, size * nmemb) != true) {
+                return 0;
+        }
 
         return size * nmemb;
 }
 
-HTTP::HTTP() {
+size_t readCb(char *buffer, size_t size, size_t nitems, void *userptr) {
+        writeData *send = (writeData*) userptr;
+        size_t len = std::min(size * nitems, send->remaining);
+
+        memcpy(buffer, send->pData, len);
+        send->pData += len;
+        send->remaining -= len;
+
+        return len;
+}
+
+struct HTTPMulti::SocketWatch {
+        explicit SocketWatch(asio::io_context& io, curl_socket_t s) : sd(io, s) {}
+
+        // curl owns the socket, the descriptor is only used to wait on it
+        asio::posix::stream_descriptor sd;
+        curl_socket_t fd = CURL_SOCKET_BAD;
+        int what = 0;
+        bool active = true;
+        bool readPending = false;
+        bool writePending = false;
+};
+
+HTTPMulti::HTTPMulti(asio::io_context& io) : ioCtx(io), timer(io) {
+        running = 0;
+
+        multi = curl_multi_init();
+        curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socketCb);
+        curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timerCb);
+        curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+}
+
+HTTPMulti::~HTTPMulti() {
+        for (auto& t : transfers) {
+                curl_multi_remove_handle(multi, t.first);
+        }
+        transfers.clear();
+
+        for (auto& s : sockets) {
+                s.second->active = false;
+                s.second->sd.release();
+        }
+        sockets.clear();
+
+        timer.cancel();
+        curl_multi_cleanup(multi);
+}
+
+bool HTTPMulti::add(CURL *easy, std::function<void(CURLcode)> done) {
+        CURLMcode res = curl_multi_add_handle(multi, easy);
+
+        if (res != CURLM_OK) {
+                cout << "Error, curl_multi_add_handle: " << curl_multi_strerror(res) << endl;
+                return false;
+        }
+
+        transfers[easy] = done;
+
+        return true;
+}
+
+void HTTPMulti::remove(CURL *easy) {
+        if (transfers.erase(easy) > 0) {
+                curl_multi_remove_handle(multi, easy);
+        }
+}
+
+int HTTPMulti::socketCb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+        HTTPMulti *self = (HTTPMulti*) userp;
+        auto it = self->sockets.find(s);
+
+        if (what == CURL_POLL_REMOVE) {
+                if (it != self->sockets.end()) {
+                        it->second->active = false;
+                        it->second->sd.release();
+                        self->sockets.erase(it);
+                }
+                return 0;
+        }
+
+        if (it == self->sockets.end()) {
+                auto watch = std::make_shared<SocketWatch>(self->ioCtx, s);
+                watch->fd = s;
+                it = self->sockets.emplace(s, watch).first;
+        }
+
+        it->second->what = what;
+        self->arm(it->second);
+
+        return 0;
+}
+
+int HTTPMulti::timerCb(CURLM *multi, long timeoutMs, void *userp) {
+        HTTPMulti *self = (HTTPMulti*) userp;
+
+        self->timer.cancel();
+
+        if (timeoutMs < 0) {
+                return 0;
+        }
+
+        // never call back into curl from inside its own callback
+        self->timer.expires_after(std::chrono::milliseconds(timeoutMs));
+        self->timer.async_wait([self](const asio::error_code& ec) {
+                if (!ec) {
+                        self->socketAction(CURL_SOCKET_TIMEOUT, 0);
+                }
+        });
+
+        return 0;
+}
+
+void HTTPMulti::arm(std::shared_ptr<SocketWatch> watch) {
+        if ((watch->what & CURL_POLL_IN) && !watch->readPending) {
+                watch->readPending = true;
+                watch->sd.async_wait(asio::posix::stream_descriptor::wait_read, [this, watch](const asio::error_code& ec) {
+                        watch->readPending = false;
+                        if (ec || !watch->active) {
+                                return;
+                        }
+                        socketAction(watch->fd, CURL_CSELECT_IN);
+                        if (watch->active) {
+                                arm(watch);
+                        }
+                });
+        }
+
+        if ((watch->what & CURL_POLL_OUT) && !watch->writePending) {
+                watch->writePending = true;
+                watch->sd.async_wait(asio::posix::stream_descriptor::wait_write, [this, watch](const asio::error_code& ec) {
+                        watch->writePending = false;
+                        if (ec || !watch->active) {
+                                return;
+                        }
+                        socketAction(watch->fd, CURL_CSELECT_OUT);
+                        if (watch->active) {
+                                arm(watch);
+                        }
+                });
+        }
+}
+
+void HTTPMulti::socketAction(curl_socket_t s, int action) {
+        CURLMcode res = curl_multi_socket_action(multi, s, action, &running);
+
+        if (res != CURLM_OK) {
+                cout << "Error, curl_multi_socket_action: " << curl_multi_strerror(res) << endl;
+        }
+
+        checkDone();
+}
+
+void HTTPMulti::checkDone(void) {
+        CURLMsg *msg;
+        int pending;
+
+        while ((msg = curl_multi_info_read(multi, &pending))) {
+                if (msg->msg != CURLMSG_DONE) {
+                        continue;
+                }
+
+                CURL *easy = msg->easy_handle;
+                CURLcode res = msg->data.result;
+
+                curl_multi_remove_handle(multi, easy);
+
+                auto it = transfers.find(easy);
+                if (it == transfers.end()) {
+                        continue;
+                }
+
+                // the completion may queue the next transfer on this handle
+                auto done = it->second;
+                transfers.erase(it);
+
+                if (done) {
+                        done(res);
+                }
+        }
+}
+
+HTTP::HTTP(HTTPMulti *multi) : multi(multi) {
+        numRequests = 0;
+        numReused = 0;
+        numConnects = 0;
+        numSent = 0;
+        numReceived = 0;
+        lastRetryAfter = 0;
+        numNotModified = 0;
+        recvSpeed = 0;
+        downloadPauses = 0;
+        response.curl = NULL;
+        response.sized = false;
+        response.allocations = 0;
+        response.copied = 0;
+        headers = NULL;
+        inFlight = false;
+
+        // DNS results, TLS session IDs/tickets and open connections outlive
+        // the individual requests, so keep them in a share handle
+        share = curl_share_init();
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
         curl = curl_easy_init();
 }
 
 HTTP::~HTTP() {
+        // a transfer still running when the session goes away must not be
+        // completed later on a freed handle
+        if ((multi != NULL) && (inFlight == true)) {
+                multi->remove(curl);
+        }
+
         curl_easy_cleanup(curl);
+        curl_share_cleanup(share);
+        curl_slist_free_all(headers);
 }
 
-std::string HTTP::get(const std::string& uri, const std::string& sslkey, const std::string& sslcert) {
-        std::stringstream response;
+void HTTP::setupRequest(const std::string& uri, const std::string& sslkey, const std::string& sslcert) {
+        // curl_easy_reset() only drops the options of the previous request,
+        // live connections and the caches in the share handle are kept
+        curl_easy_reset(curl);
+        curl_slist_free_all(headers);
+        headers = NULL;
 
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
         curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
         curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
         curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
         curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "deflate");
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCb);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+        // keep the connection across a default 5 minute poll interval
+        curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, 900L);
+        curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 900L);
 
         if ((sslkey.empty() != true) && (sslcert.empty() != true)) {
                 curl_easy_setopt(curl, CURLOPT_SSLKEY, sslkey.c_str());
@@ -72,102 +359,305 @@ std::string HTTP::get(const std::string& uri, const std::string& sslkey, const s
 
                 curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
                 curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+                curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
         }
+}
 
-        CURLcode res = curl_easy_perform(curl);
+void HTTP::setupBody(method_t method, const char *data, ssize_t size) {
+        if (method == METHOD_GET) {
+                return;
+        }
 
-        if (res != CURLE_OK) {
-                cout << "Error, curl_easy_perform: " << curl_easy_strerror(res) << endl;
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        if (method == METHOD_POST) {
+                curl_easy_setopt(curl, CURLOPT_POST, 1L);
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) size);
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+        } else {
+                upload.pData = data;
+                upload.remaining = size;
+
+                curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+                curl_easy_setopt(curl, CURLOPT_READFUNCTION, readCb);
+                curl_easy_setopt(curl, CURLOPT_READDATA, &upload);
+                curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t) size);
+        }
+}
+
+void HTTP::setupBuffer(void) {
+        // one large body must not pin its buffer for the life of the session
+        if (response.body.capacity() > HTTP_BUFFER_KEEP) {
+                std::string().swap(response.body);
+        }
+
+        response.body.clear();
+        response.curl = curl;
+        response.sized = false;
+
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCb);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+}
+
+void HTTP::setupConditional(const std::string& uri) {
+        received = validatorData();
+
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCb);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+
+        auto v = validators.find(uri);
+
+        if (v == validators.end()) {
+                return;
+        }
+
+        // the entity tag is the stronger validator, the date is only the
+        // fallback for servers that don't send one
+        if (v->second.etag.empty() != true) {
+                headers = curl_slist_append(headers, ("If-None-Match: " + v->second.etag).c_str());
+        } else if (v->second.lastModified.empty() != true) {
+                headers = curl_slist_append(headers, ("If-Modified-Since: " + v->second.lastModified).c_str());
         }
 
-        return response.str();
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 }
 
-bool HTTP::post(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size) {
-        writeData send;
+void HTTP::updateValidators(const std::string& uri, long status) {
+        if (status == 304) {
+                numNotModified++;
+                return;
+        }
 
-        struct curl_slist *list = NULL;
-        list = curl_slist_append(list, "Content-Type: application/json");
+        if (status != 200) {
+                return;
+        }
 
-        send.pData = data;
-        send.remaining = size;
+        if (received.etag.empty() && received.lastModified.empty()) {
+                validators.erase(uri);
+        } else {
+                validators[uri] = received;
+        }
+}
 
-        curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
-        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "deflate");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+void HTTP::recordPhases(long connects) {
+        Metrics& m = Metrics::instance();
+        curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, ttfb = 0, total = 0;
 
-        if ((sslkey.empty() != true) && (sslcert.empty() != true)) {
-                curl_easy_setopt(curl, CURLOPT_SSLKEY, sslkey.c_str());
-                curl_easy_setopt(curl, CURLOPT_SSLCERT, sslcert.c_str());
+        // all times are in us since the start of the request
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+        curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
 
-                if ((strncasecmp(sslkey, "pkcs11:", 7) == 1) || (strncasecmp(sslcert, "pkcs11:", 7) == 1)) {
-                        curl_easy_setopt(curl, CURLOPT_SSLENGINE, "pkcs11");
-                }
+        m.add("egt_swupdate_http_requests_total");
 
-                if (strncasecmp(sslkey, "pkcs11:", 7) == 1) {
-                        curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "ENG");
+        // a reused connection has no lookup, connect or handshake of its own
+        if (connects > 0) {
+                m.observe("egt_swupdate_http_dns_seconds", dns / 1e6);
+                m.observe("egt_swupdate_http_connect_seconds", std::max(connect - dns, (curl_off_t) 0) / 1e6);
+
+                if (tls > 0) {
+                        m.observe("egt_swupdate_http_tls_seconds", std::max(tls - connect, (curl_off_t) 0) / 1e6);
                 }
-                if (strncasecmp(sslcert, "pkcs11:", 7) == 1) {
-                        curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "ENG");
+        }
+
+        if (ttfb > 0) {
+                m.observe("egt_swupdate_http_ttfb_seconds", std::max(ttfb - pretransfer, (curl_off_t) 0) / 1e6);
+                m.observe("egt_swupdate_http_transfer_seconds", std::max(total - ttfb, (curl_off_t) 0) / 1e6);
+        }
+
+        m.observe("egt_swupdate_http_request_seconds", total / 1e6);
+}
+
+void HTTP::pauseDownload(bool pause) {
+        // the throttle and the slot writer pause independently, reading
+        // resumes once neither holds the download back
+        if (pause == true) {
+                if (downloadPauses++ > 0) {
+                        return;
                 }
+        } else if ((downloadPauses == 0) || (--downloadPauses > 0)) {
+                return;
+        }
 
-                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+        if ((inFlight == true) && (current.sink != NULL)) {
+                curl_easy_pause(curl, pause ? CURLPAUSE_RECV : CURLPAUSE_CONT);
+        }
+}
+
+bool HTTP::finishRequest(CURLcode res) {
+        long connects = 0;
+        long headerSize = 0;
+        long requestSize = 0;
+        curl_off_t uploaded = 0;
+        curl_off_t downloaded = 0;
+
+        numRequests++;
+
+        // headers and bodies as they went over the wire, before TLS framing
+        curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &requestSize);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+        curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &headerSize);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+
+        numSent += requestSize + uploaded;
+        numReceived += headerSize + downloaded;
+
+        if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK) {
+                numConnects += connects;
         }
 
-        CURLcode res = curl_easy_perform(curl);
+        // sent with 429 and 503 answers, the poll scheduler waits at least this long
+        if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &lastRetryAfter) != CURLE_OK) {
+                lastRetryAfter = 0;
+        }
 
         if (res != CURLE_OK) {
                 cout << "Error, curl_easy_perform: " << curl_easy_strerror(res) << endl;
+                Metrics::instance().add("egt_swupdate_http_errors_total");
                 return false;
         }
 
-        curl_slist_free_all(list);
+        recordPhases(connects);
+
+        // no new connection means no new TCP connect and TLS handshake
+        if (connects == 0) {
+                numReused++;
+        }
 
         return true;
 }
 
+bool HTTP::perform(void) {
+        return finishRequest(curl_easy_perform(curl));
+}
+
+std::string HTTP::get(const std::string& uri, const std::string& sslkey, const std::string& sslcert) {
+        setupRequest(uri, sslkey, sslcert);
+        setupBuffer();
+
+        perform();
+
+        return response.body;
+}
+
+bool HTTP::post(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size) {
+        setupRequest(uri, sslkey, sslcert);
+        setupBody(METHOD_POST, data, size);
+
+        return perform();
+}
+
 bool HTTP::put(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size) {
-        struct curl_slist *list = NULL;
-        list = curl_slist_append(list, "Content-Type: application/json");
+        setupRequest(uri, sslkey, sslcert);
+        setupBody(METHOD_PUT, data, size);
 
-        curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
-        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+        return perform();
+}
 
-        if ((sslkey.empty() != true) && (sslcert.empty() != true)) {
-                curl_easy_setopt(curl, CURLOPT_SSLKEY, sslkey.c_str());
-                curl_easy_setopt(curl, CURLOPT_SSLCERT, sslcert.c_str());
+void HTTP::get(const std::string& uri, const std::string& sslkey, const std::string& sslcert, Completion done, bool conditional) {
+        enqueue({METHOD_GET, uri, sslkey, sslcert, std::string(), done, NULL, 0, conditional});
+}
 
-                if ((strncasecmp(sslkey, "pkcs11:", 7) == 1) || (strncasecmp(sslcert, "pkcs11:", 7) == 1)) {
-                        curl_easy_setopt(curl, CURLOPT_SSLENGINE, "pkcs11");
-                }
+void HTTP::post(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size, Completion done) {
+        enqueue({METHOD_POST, uri, sslkey, sslcert, std::string(data, size), done, NULL, 0, false});
+}
 
-                if (strncasecmp(sslkey, "pkcs11:", 7) == 1) {
-                        curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "ENG");
-                }
-                if (strncasecmp(sslcert, "pkcs11:", 7) == 1) {
-                        curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "ENG");
-                }
+void HTTP::put(const std::string& uri, const std::string& sslkey, const std::string& sslcert, const char *data, ssize_t size, Completion done) {
+        enqueue({METHOD_PUT, uri, sslkey, sslcert, std::string(data, size), done, NULL, 0, false});
+}
 
-                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+void HTTP::download(const std::string& uri, const std::string& sslkey, const std::string& sslcert, HTTPSink *sink, Completion done, curl_off_t offset) {
+        enqueue({METHOD_GET, uri, sslkey, sslcert, std::string(), done, sink, offset, false});
+}
+
+void HTTP::enqueue(request_t req) {
+        if (multi == NULL) {
+                cout << "Error, HTTP session has no event loop for async requests" << endl;
+                if (req.done) {
+                        req.done(false, 0, std::string());
+                }
+                return;
         }
 
-        CURLcode res = curl_easy_perform(curl);
+        queue.push_back(std::move(req));
 
-        if (res != CURLE_OK) {
-                cout << "Error, curl_easy_perform: " << curl_easy_strerror(res) << endl;
-                return false;
+        if (inFlight == false) {
+                startNext();
         }
+}
 
-        curl_slist_free_all(list);
+void HTTP::startNext(void) {
+        while (!queue.empty()) {
+                current = std::move(queue.front());
+                queue.pop_front();
 
-        return true;
+                response.body.clear();
+
+                setupRequest(current.uri, current.sslkey, current.sslcert);
+                setupBody(current.method, current.body.data(), current.body.size());
+
+                if (current.sink != NULL) {
+                        receive.sink = current.sink;
+                        receive.curl = curl;
+                        receive.started = false;
+
+                        // don't hand error pages to the sink
+                        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+                        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, sinkCb);
+                        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &receive);
+
+                        if (current.offset > 0) {
+                                // sends "Range: bytes=<offset>-"
+                                curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, current.offset);
+                        }
+
+                        if (recvSpeed > 0) {
+                                curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, recvSpeed);
+                        }
+                } else {
+                        setupBuffer();
+
+                        if (current.conditional == true) {
+                                setupConditional(current.uri);
+                        }
+                }
+
+                inFlight = multi->add(curl, [this](CURLcode res) {
+                        long status = 0;
+                        bool ok = finishRequest(res);
+
+                        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+
+                        if ((ok == true) && (current.conditional == true)) {
+                                updateValidators(current.uri, status);
+                        }
+
+                        // the callback may queue more requests, they only start
+                        // once it has returned so the body it is looking at
+                        // stays in place
+                        Completion done = std::move(current.done);
+
+                        if (done) {
+                                done(ok, status, response.body);
+                        }
+
+                        inFlight = false;
+                        startNext();
+                });
+
+                if (inFlight == true) {
+                        if ((current.sink != NULL) && (downloadPauses > 0)) {
+                                curl_easy_pause(curl, CURLPAUSE_RECV);
+                        }
+                        return;
+                }
+
+                if (current.done) {
+                        current.done(false, 0, std::string());
+                }
+        }
 }
@@ -0,0 +1,645 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <mtd/ubi-user.h>
+#include "installer.h"
+#include "hash.h"
+
+using namespace std;
+
+// no buffer is being filled while the download waits for the writer
+static const size_t NO_BUFFER = SIZE_MAX;
+
+static bool writeFull(int fd, const unsigned char *p, size_t len) {
+        while (len > 0) {
+                ssize_t ret = ::write(fd, p, len);
+
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return false;
+                }
+
+                p += ret;
+                len -= ret;
+        }
+
+        return true;
+}
+
+SlotWriter::SlotWriter(asio::io_context& io) : io(io) {
+        size = 0;
+        fd = -1;
+        ubi = false;
+        direct = false;
+        verifyReadback = true;
+        filling = 0;
+        paused = false;
+        running = false;
+        failed = false;
+        numReceived = 0;
+        numWritten = 0;
+        numStalls = 0;
+        draining = false;
+        hashDone = false;
+        cancelled = false;
+        waiting = false;
+        mdCtx = NULL;
+}
+
+SlotWriter::~SlotWriter() {
+        abort();
+
+        for (auto& buf : buffers) {
+                free(buf.data);
+        }
+}
+
+bool SlotWriter::active(const std::string& device) {
+        struct stat root, dev;
+
+        if ((stat("/", &root) != 0) || (stat(device.c_str(), &dev) != 0)) {
+                return false;
+        }
+
+        return S_ISBLK(dev.st_mode) && (dev.st_rdev == root.st_dev);
+}
+
+bool SlotWriter::open(const std::string& device, size_t size, Backpressure backpressure) {
+        struct stat st;
+
+        if (running == true) {
+                cout << "Slot install already in progress" << endl;
+                return false;
+        }
+
+        if (stat(device.c_str(), &st) != 0) {
+                cout << "Error opening " << device << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (active(device) == true) {
+                cout << "Not installing into " << device << ", the system runs from it" << endl;
+                return false;
+        }
+
+        this->device = device;
+        this->size = size;
+        this->backpressure = backpressure;
+
+        // UBI volumes are character devices and don't support O_DIRECT,
+        // files on tmpfs neither
+        ubi = S_ISCHR(st.st_mode);
+        direct = !ubi;
+        fd = ::open(device.c_str(), O_WRONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+
+        if ((fd < 0) && (direct == true) && (errno == EINVAL)) {
+                direct = false;
+                fd = ::open(device.c_str(), O_WRONLY | O_CLOEXEC);
+        }
+
+        if (fd < 0) {
+                cout << "Error opening " << device << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        if (ubi == true) {
+                int64_t bytes = size;
+
+                // the volume is marked corrupted until exactly this many
+                // bytes have been written
+                if ((size == 0) || (ioctl(fd, UBI_IOCVOLUP, &bytes) != 0)) {
+                        cout << "Error starting UBI volume update of " << device << ": " << (size ? strerror(errno) : "size unknown") << endl;
+                        release();
+                        return false;
+                }
+        } else if (S_ISBLK(st.st_mode)) {
+                uint64_t capacity = 0;
+
+                if ((ioctl(fd, BLKGETSIZE64, &capacity) == 0) && (size > capacity)) {
+                        cout << "Artifact of " << size << " bytes does not fit into " << device << endl;
+                        release();
+                        return false;
+                }
+        } else if (ftruncate(fd, 0) != 0) {
+                cout << "Error truncating " << device << ": " << strerror(errno) << endl;
+                release();
+                return false;
+        }
+
+        if (buffers.empty()) {
+                for (size_t i = 0; i < INSTALL_BUFFERS; i++) {
+                        void *data = NULL;
+
+                        if (posix_memalign(&data, INSTALL_ALIGN, INSTALL_BUFFER_SIZE) != 0) {
+                                cout << "Error allocating install buffers" << endl;
+                                release();
+                                return false;
+                        }
+
+                        buffers.push_back({(unsigned char*) data, 0});
+                }
+        }
+
+        mdCtx = EVP_MD_CTX_new();
+
+        if ((mdCtx == NULL) || (EVP_DigestInit_ex(mdCtx, EVP_sha256(), NULL) != 1)) {
+                cout << "Error initializing SHA-256" << endl;
+                release();
+                return false;
+        }
+
+        freeList.clear();
+        hashQueue.clear();
+        writeQueue.clear();
+
+        for (size_t i = 1; i < buffers.size(); i++) {
+                freeList.push_back(i);
+        }
+
+        filling = 0;
+        buffers[filling].len = 0;
+        overflow.clear();
+        paused = false;
+        failed = false;
+        draining = false;
+        hashDone = false;
+        cancelled = false;
+        waiting = false;
+        numReceived = 0;
+        numWritten = 0;
+        numStalls = 0;
+        running = true;
+
+        hashThread = std::thread([this]() { hasher(); });
+        writeThread = std::thread([this]() { writer(); });
+
+        cout << "Installing into " << device << (direct ? " with O_DIRECT" : "") << (ubi ? " as UBI volume update" : "") << endl;
+
+        return true;
+}
+
+bool SlotWriter::start(long status) {
+        // a slot is always written from the start, there is no resume
+        if (status != 200) {
+                cout << "Unexpected status " << status << " for slot download" << endl;
+                failed = true;
+                return false;
+        }
+
+        return true;
+}
+
+bool SlotWriter::write(const char *data, size_t len) {
+        if ((running != true) || (failed == true)) {
+                return false;
+        }
+
+        numReceived += len;
+
+        if (paused == true) {
+                if (overflow.size() + len <= INSTALL_OVERFLOW_MAX) {
+                        overflow.append(data, len);
+                        return true;
+                }
+
+                // one received chunk unpacked to more than may be held back,
+                // wait for the writer instead of buffering all of it
+                if ((filling == NO_BUFFER) && (take(true) != true)) {
+                        return false;
+                }
+
+                std::string held;
+
+                held.swap(overflow);
+                push(held.data(), held.size(), true);
+                push(data, len, true);
+
+                return true;
+        }
+
+        if (push(data, len, false) != true) {
+                // the writer is behind, stop reading until it hands a
+                // buffer back
+                paused = true;
+                numStalls++;
+                backpressure(true);
+        }
+
+        return true;
+}
+
+bool SlotWriter::push(const char *data, size_t len, bool block) {
+        while (len > 0) {
+                buffer_t& buf = buffers[filling];
+                size_t n = std::min(len, INSTALL_BUFFER_SIZE - buf.len);
+
+                memcpy(buf.data + buf.len, data, n);
+                buf.len += n;
+                data += n;
+                len -= n;
+
+                if (buf.len < INSTALL_BUFFER_SIZE) {
+                        break;
+                }
+
+                {
+                        std::lock_guard<std::mutex> guard(lock);
+
+                        hashQueue.push_back(filling);
+                        hashReady.notify_one();
+                        filling = NO_BUFFER;
+                }
+
+                if (take(block || (len > INSTALL_OVERFLOW_MAX)) != true) {
+                        overflow.assign(data, len);
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+bool SlotWriter::take(bool block) {
+        std::unique_lock<std::mutex> guard(lock);
+
+        if (freeList.empty()) {
+                if (block != true) {
+                        waiting = true;
+                        return false;
+                }
+
+                bufferFreed.wait(guard, [this]() { return !freeList.empty() || cancelled; });
+
+                if (freeList.empty()) {
+                        return false;
+                }
+        }
+
+        filling = freeList.front();
+        freeList.pop_front();
+        buffers[filling].len = 0;
+
+        return true;
+}
+
+void SlotWriter::refill(void) {
+        // a wake up posted by the writer may only run after finish()
+        if ((running != true) || (paused != true) || (draining == true)) {
+                return;
+        }
+
+        // a buffer may have been taken by a blocking write since, then the
+        // writer wakes us again
+        if ((filling == NO_BUFFER) && (take(false) != true)) {
+                return;
+        }
+
+        std::string held;
+
+        held.swap(overflow);
+
+        // at most INSTALL_OVERFLOW_MAX, less than a buffer
+        push(held.data(), held.size(), true);
+        paused = false;
+
+        // curl may deliver data it held back right from here
+        backpressure(false);
+}
+
+void SlotWriter::hasher(void) {
+        for (;;) {
+                size_t i;
+
+                {
+                        std::unique_lock<std::mutex> guard(lock);
+
+                        hashReady.wait(guard, [this]() { return !hashQueue.empty() || draining || cancelled; });
+
+                        if (cancelled) {
+                                return;
+                        }
+
+                        if (hashQueue.empty()) {
+                                hashDone = true;
+                                writeReady.notify_one();
+                                return;
+                        }
+
+                        i = hashQueue.front();
+                        hashQueue.pop_front();
+                }
+
+                if (EVP_DigestUpdate(mdCtx, buffers[i].data, buffers[i].len) != 1) {
+                        cout << "SHA-256 update failed" << endl;
+                        failed = true;
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+
+                writeQueue.push_back(i);
+                writeReady.notify_one();
+        }
+}
+
+void SlotWriter::writer(void) {
+        std::string digest;
+
+        for (;;) {
+                size_t i;
+
+                {
+                        std::unique_lock<std::mutex> guard(lock);
+
+                        writeReady.wait(guard, [this]() { return !writeQueue.empty() || hashDone || cancelled; });
+
+                        if (cancelled) {
+                                return;
+                        }
+
+                        if (writeQueue.empty()) {
+                                break;
+                        }
+
+                        i = writeQueue.front();
+                        writeQueue.pop_front();
+                }
+
+                if ((failed != true) && (store(buffers[i]) != true)) {
+                        failed = true;
+                }
+
+                bool wake;
+
+                {
+                        std::lock_guard<std::mutex> guard(lock);
+
+                        freeList.push_back(i);
+                        bufferFreed.notify_one();
+                        wake = waiting;
+                        waiting = false;
+                }
+
+                if (wake == true) {
+                        asio::post(io, [this]() { refill(); });
+                }
+        }
+
+        bool ok = (failed != true) && (complete(digest) == true);
+
+        asio::post(io, [this, ok, digest]() {
+                Completion cb = std::move(done);
+
+                stop();
+
+                if (cb) {
+                        cb(ok, digest);
+                }
+        });
+}
+
+bool SlotWriter::store(const buffer_t& buf) {
+        size_t aligned = direct ? (buf.len / INSTALL_ALIGN) * INSTALL_ALIGN : buf.len;
+
+        if (writeFull(fd, buf.data, aligned) != true) {
+                cout << "Error writing " << device << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        // only the last buffer can end unaligned, it is written through
+        // the page cache
+        if (aligned < buf.len) {
+                int flags = fcntl(fd, F_GETFL);
+
+                if ((flags < 0) || (fcntl(fd, F_SETFL, flags & ~O_DIRECT) != 0) ||
+                    (writeFull(fd, buf.data + aligned, buf.len - aligned) != true)) {
+                        cout << "Error writing " << device << ": " << strerror(errno) << endl;
+                        return false;
+                }
+
+                direct = false;
+        }
+
+        numWritten += buf.len;
+
+        return true;
+}
+
+bool SlotWriter::complete(std::string& digest) {
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int mdLen = 0;
+
+        if (EVP_DigestFinal_ex(mdCtx, md, &mdLen) != 1) {
+                cout << "SHA-256 final failed" << endl;
+                return false;
+        }
+
+        digest = HashEngine::toHex(md, mdLen);
+
+        if ((size > 0) && (numWritten != size)) {
+                cout << "Wrote " << numWritten << " bytes to " << device << ", expected " << size << endl;
+                return false;
+        }
+
+        size = numWritten;
+
+        // the only sync of the install
+        if (fsync(fd) != 0) {
+                cout << "Error syncing " << device << ": " << strerror(errno) << endl;
+                return false;
+        }
+
+        ::close(fd);
+        fd = -1;
+
+        if ((verifyReadback == true) && (verify(digest) != true)) {
+                return false;
+        }
+
+        return true;
+}
+
+bool SlotWriter::verify(const std::string& digest) {
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int mdLen = 0;
+        bool ok = (ctx != NULL) && (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1);
+        unsigned char *buf = buffers[0].data;
+        size_t done = 0;
+
+        // every buffer is back on the free list, and the read must come from
+        // the flash rather than the page cache
+        int rfd = ::open(device.c_str(), O_RDONLY | O_CLOEXEC | (ubi ? 0 : O_DIRECT));
+
+        if ((rfd < 0) && (errno == EINVAL)) {
+                rfd = ::open(device.c_str(), O_RDONLY | O_CLOEXEC);
+
+                if (rfd >= 0) {
+                        posix_fadvise(rfd, 0, size, POSIX_FADV_DONTNEED);
+                }
+        }
+
+        if (rfd < 0) {
+                cout << "Error opening " << device << " for read back: " << strerror(errno) << endl;
+                EVP_MD_CTX_free(ctx);
+                return false;
+        }
+
+        while (ok && (done < size)) {
+                size_t want = std::min((size_t) INSTALL_BUFFER_SIZE, ((size - done + INSTALL_ALIGN - 1) / INSTALL_ALIGN) * INSTALL_ALIGN);
+                ssize_t ret = pread(rfd, buf, want, done);
+
+                if ((ret < 0) && (errno == EINTR)) {
+                        continue;
+                }
+
+                if (ret <= 0) {
+                        cout << "Error reading back " << device << ": " << (ret ? strerror(errno) : "short read") << endl;
+                        ok = false;
+                        break;
+                }
+
+                size_t n = std::min((size_t) ret, size - done);
+
+                ok = (EVP_DigestUpdate(ctx, buf, n) == 1);
+                done += n;
+        }
+
+        ::close(rfd);
+
+        ok = ok && (EVP_DigestFinal_ex(ctx, md, &mdLen) == 1);
+        EVP_MD_CTX_free(ctx);
+
+        if (ok != true) {
+                return false;
+        }
+
+        if (HashEngine::toHex(md, mdLen) != digest) {
+                cout << "Read back of " << device << " does not match what was written" << endl;
+                return false;
+        }
+
+        return true;
+}
+
+bool SlotWriter::flush(void) {
+        if ((running != true) || (failed == true)) {
+                return false;
+        }
+
+        if (paused != true) {
+                return true;
+        }
+
+        // the last chunks may have arrived after the writer fell behind,
+        // nothing follows them so waiting on the event loop is fine
+        if ((filling == NO_BUFFER) && (take(true) != true)) {
+                return false;
+        }
+
+        std::string held;
+
+        held.swap(overflow);
+
+        if (push(held.data(), held.size(), true) != true) {
+                return false;
+        }
+
+        paused = false;
+        backpressure(false);
+
+        return true;
+}
+
+void SlotWriter::finish(Completion done) {
+        if (running != true) {
+                if (done) {
+                        done(false, "");
+                }
+                return;
+        }
+
+        this->done = done;
+
+        if (flush() != true) {
+                failed = true;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (filling == NO_BUFFER) {
+                // nothing left over
+        } else if (buffers[filling].len > 0) {
+                hashQueue.push_back(filling);
+        } else {
+                freeList.push_back(filling);
+        }
+
+        filling = NO_BUFFER;
+        draining = true;
+        hashReady.notify_one();
+}
+
+void SlotWriter::abort(void) {
+        if (running != true) {
+                return;
+        }
+
+        {
+                std::lock_guard<std::mutex> guard(lock);
+
+                cancelled = true;
+                hashReady.notify_one();
+                writeReady.notify_one();
+        }
+
+        stop();
+        done = nullptr;
+}
+
+void SlotWriter::stop(void) {
+        if (hashThread.joinable()) {
+                hashThread.join();
+        }
+
+        if (writeThread.joinable()) {
+                writeThread.join();
+        }
+
+        // the download must not stay paused by an install that is gone
+        if (paused == true) {
+                paused = false;
+                backpressure(false);
+        }
+
+        overflow.clear();
+        running = false;
+        release();
+}
+
+void SlotWriter::release(void) {
+        if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+        }
+
+        if (mdCtx != NULL) {
+                EVP_MD_CTX_free(mdCtx);
+                mdCtx = NULL;
+        }
+}
@@ -6,6 +6,7 @@
 
 #include <iostream>
 #include <cxxopts.hpp>
+#include <curl/curl.h>
 #include <egt/themes/lapis.h>
 #include "mainwin.h"
 
@@ -29,6 +30,8 @@ int main(int argc, char** argv) {
 		return 0;
 	}
 
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
 	Application app(argc, argv);
 
 	global_theme(std::make_unique<LapisTheme>());
@@ -37,7 +40,11 @@ int main(int argc, char** argv) {
 
 	window.show();
 
-	return app.run();
+	int ret = app.run();
+
+	curl_global_cleanup();
+
+	return ret;
 }
 
 
@@ -5,50 +5,21 @@
  */
 
 #include <iostream>
-#include <sstream>
 #include <ctime>
-#include <filesystem>
 #include <fstream>
-#include <openssl/sha.h>
-#include <openssl/evp.h>
-#include <openssl/err.h>
-#include <nlohmann/json.hpp>
 #include "mainwin.h"
-#include "http.h"
 
 using namespace std;
 using namespace egt;
 using namespace egt::experimental;
-using json = nlohmann::json;
 
-static std::string getTime(void) {
-        time_t sysTime = time(0);
-        return ctime(&sysTime);
-}
-
-MainWindow::MainWindow(std::string const cfg) {
-        provisioned = false;
-        ubootCtx = NULL;
-        ustate = 0;
-        serverPollTime = 300;   // 5 min default
-        updateAvailable = false;
-        updateInstalled = false;
-
-        appDataFile = std::string("/opt/data/app_data.img");
-        hashAppData(appDataFile, appDataMd);
-
-        initUbootEnvAccess();
-        checkIfUpdated();
-        readConfigFile(cfg);
-        getServerAttrs();
-
-        std::string boardVer, serNum, hwVer, swVer, appVer, certFile;
+MainWindow::MainWindow(std::string const cfg) : updater(Application::instance().event().io(), cfg) {
+        std::string boardVer, serNum, hwVer, swVer, appVer;
 
-        getAttrFromCfg("identify", "board", "value", boardVer);
-        getAttrFromCfg("identify", "serial", "value", serNum);
-        getAttrFromCfg("identify", "HW Version", "value", hwVer);
-        getAttrFromCfg("identify", "SW Version", "value", swVer);
-        getAttrFromCfg("suricatta", "sslcert", certFile);
+        updater.getAttrFromCfg("identify", "board", "value", boardVer);
+        updater.getAttrFromCfg("identify", "serial", "value", serNum);
+        updater.getAttrFromCfg("identify", "HW Version", "value", hwVer);
+        updater.getAttrFromCfg("identify", "SW Version", "value", swVer);
 
         auto hsizer = make_shared<BoxSizer>(Orientation::horizontal);
         auto vsizer = make_shared<BoxSizer>(egt::Orientation::vertical);
@@ -57,60 +28,17 @@ MainWindow::MainWindow(std::string const cfg) {
 
         add(expand(vsizer));
 
-        auto header = make_shared<Frame>(Size(0, 60));
-
-        header->fill_flags(Theme::FillFlag::blend);
-        header->height(50);
+        header = make_shared<StatusBar>("A Super Cool App ");
+        header->provisioned(updater.provisioned());
 
         vsizer->add(expand_horizontal(header));
         vsizer->add(expand(hsizer));
         hsizer->add(expand(attrSizer));
         hsizer->add(expand(verSizer));
 
-        timeClock = make_shared<Label>(getTime(), AlignFlag::center);
-        timeClock->color(Palette::ColorId::bg, Palette::transparent);
-        timeClock->align(AlignFlag::center_horizontal | AlignFlag::center_vertical);
-        timeClock->margin(10);
-        timeClock->font(egt::Font(24));
-        header->add(timeClock);
-
-        auto appName = make_shared<ImageLabel>(egt::Image("icon:cancel.png"), "A Super Cool App ");
-        appName->color(Palette::ColorId::bg, Palette::transparent);
-        appName->align(AlignFlag::left | AlignFlag::center_vertical);
-        appName->image_align(AlignFlag::right);
-        appName->margin(10);
-        appName->font(egt::Font(24));
-        header->add(appName);
-
-        if (std::filesystem::exists(certFile) == true) {
-                provisioned = true;
-                appName->image(egt::Image("icon:ok.png"));
-        }
-
-        cpuMon = CPUMonitorUsage();
-        cpuMonLabel = make_shared<Label>("CPU:---", Rect(0, 0, 100, 50));
-        cpuMonLabel->color(Palette::ColorId::bg, Palette::transparent);
-        cpuMonLabel->align(AlignFlag::right | AlignFlag::top);
-        cpuMonLabel->margin(10);
-        cpuMonLabel->font(egt::Font(24));
-        header->add(cpuMonLabel);
-
-        cpuTimer = PeriodicTimer(std::chrono::seconds(1));
-
-        cpuTimer.on_timeout([this, appName, certFile]() {
-                cpuMon.update();
-                ostringstream ss;
-                ss << "CPU: " << static_cast<int>(cpuMon.usage()) << "%";
-                cpuMonLabel->text(ss.str());
-
-                timeClock->text(getTime());
-
-                if (provisioned == false) {
-                        if (std::filesystem::exists(certFile) == true) {
-                                provisioned = true;
-                                appName->image(egt::Image("icon:ok.png"));
-                        }
-                }
+        // the updater watches for the certificate, nothing to poll here
+        updater.onProvisioned([this]() {
+                header->provisioned(true);
         });
 
         auto board = make_shared<Label>("Board:", AlignFlag::left);
@@ -193,7 +121,7 @@ MainWindow::MainWindow(std::string const cfg) {
         appVersion->margin(10);
         appVersion->font(egt::Font(24));
 
-        auto appHash = make_shared<Label>(appDataMd.substr(0, 22) + " ...", AlignFlag::left);
+        appHash = make_shared<Label>(updater.hashing() ? "computing..." : updater.appDataDigest().substr(0, 22) + " ...", AlignFlag::left);
         appHash->color(Palette::ColorId::bg, Palette::transparent);
         appHash->align(AlignFlag::left | AlignFlag::top);
         appHash->margin(10);
@@ -213,282 +141,57 @@ MainWindow::MainWindow(std::string const cfg) {
         verSizer->add(appHash);
         verSizer->add(pollTime);
 
-        cpuTimer.start();
-
-        pollHawkbitServer();
-        sendMsgToHawkbitServer();
+        auto diagnostics = make_shared<Button>("Diagnostics");
+        diagnostics->align(AlignFlag::right | AlignFlag::bottom);
+        diagnostics->margin(10);
+        vsizer->add(diagnostics);
 
-        updatePollTimer = PeriodicTimer(std::chrono::seconds(serverPollTime));
-
-        updatePollTimer.on_timeout([this]() {
-                // check for new poll time
-                pollHawkbitServer();
-                sendMsgToHawkbitServer();
-
-                if (updateAvailable == true) {
-                        if (setUpdateAvailableInUbootEnv() != 0) {
-                                cout << "Error setting u-boot env, not rebooting" << endl;
-                        } else {
-                                rebootWin.startRebootTimer(10);
-                                rebootWin.show_modal(true);
-                        }
-                }
+        diagnostics->on_click([this](Event&) {
+                diagWin.open();
         });
 
-        updatePollTimer.start();
-}
-
-MainWindow::~MainWindow() {
-
-}
-
-bool MainWindow::readConfigFile(std::string cfgFile) {
-        try {
-                swupdateCfg.readFile(cfgFile.c_str());
-                return true;
-        } catch(const libconfig::FileIOException &fioex) {
-                std::cerr << "I/O error while reading config file." << std::endl;
-                return false;
-        } catch(const libconfig::ParseException &pex) {
-                std::cerr << "Parse error at " << pex.getFile() << ":" << pex.getLine() << " - " << pex.getError() << std::endl;
-                return false;
-        }
-}
-
-bool MainWindow::getAttrFromCfg(std::string node, std::string attr, std::string& val) {
-        try {
-                libconfig::Setting &root = swupdateCfg.getRoot();
-
-                const libconfig::Setting &n = root.lookup(node);
-
-                if (n.exists(attr)) {
-                        n.lookupValue(attr, val);
-                        return true;
-                }
-
-                return false;
-
-        } catch(const libconfig::SettingNotFoundException &nfex) {
-                return false;
-        }
-}
-
-bool MainWindow::getAttrFromCfg(std::string node, std::string subnode, std::string key, std::string& val) {
-        try {
-                libconfig::Setting &root = swupdateCfg.getRoot();
-                const libconfig::Setting &n = root.lookup(node);
-
-                for (libconfig::Setting const& sn : n) {
-                        std::string snName;
-                        sn.lookupValue("name", snName);
-                        if (snName == subnode) {
-                                sn.lookupValue(key, val);
-                                return true;
-                        }
-                }
-        } catch(const libconfig::SettingNotFoundException &nfex) {
-                return false;
-        }
-
-        return false;
-}
-
-size_t MainWindow::initUbootEnvAccess(void) {
-        int ret = 0;
-        const char *ns;
-        const char *value;
-
-        ret = libuboot_read_config_ext(&ubootCtx, "/etc/fw_env.config");
-
-        if (ret) {
-		cout << "Cannot initialize u-boot env" << endl;
-                return -1;
-	}
-
-	ns = libuboot_namespace_from_dt();
-
-        if (ns) {
-                ubootCtx = libuboot_get_namespace(ubootCtx, ns);
-        }
-
-	if (!ubootCtx) {
-		cout << "Namespace not found" << endl;
-		return -1;
-	}
-
-	if ((ret = libuboot_open(ubootCtx)) < 0) {
-		cout << "Cannot read environment" << endl;
-                return -1;
-	}
-
-        value = libuboot_get_env(ubootCtx, "ustate");
-
-        ustate = stoi(value);
-
-        libuboot_close(ubootCtx);
-
-        return 0;
-}
-
-size_t MainWindow::setUbootEnvVar(ubootEnvVars_t var, std::string val) {
-        int ret;
-        const char *value;
-
-        cout << "Setting " << ubootEnvVars.at(var) << " to " << val << endl;
-        value = libuboot_get_env(ubootCtx, ubootEnvVars.at(var).c_str());
-
-        if (value == NULL || val.compare(value) != 0) {
-                writeUbootEnv = true;
-
-                ret = libuboot_set_env(ubootCtx, ubootEnvVars.at(var).c_str(), val.c_str());
-                if (ret) {
-                        cout << "libuboot_set_env failed: " << ret << endl;
-                        return -1;
-                }
-        } else {
-                cout << "Not setting " << ubootEnvVars.at(var) << ", value is the same." << endl;
-                writeUbootEnv = false;
-        }
-
-        return 0;
-}
-
-size_t MainWindow::writeUbootVarToEnv(ubootEnvVars_t var, std::string val) {
-        int ret;
-
-        if ((ret = libuboot_open(ubootCtx)) < 0) {
-		cout << "Cannot read environment" << endl;
-                return -1;
-	}
-
-        if (setUbootEnvVar(var, val) != 0) {
-                return -1;
-        };
-
-        if (writeUbootEnv == true) {
-                cout << "Writing u-boot env to memory." << endl;
-                writeUbootEnv = false;
+        hashProgressTimer = PeriodicTimer(std::chrono::milliseconds(250));
 
-                ret = libuboot_env_store(ubootCtx);
-
-                if (ret) {
-                        cout << "Error storing the env" << endl;
-                        return -1;
-                }
-        }
-
-        libuboot_close(ubootCtx);
-
-        return 0;
-}
-
-void MainWindow::checkIfUpdated(void) {
-        if ((ustate == STATE_INSTALLED) || (ustate == STATE_TESTING)) {
-                cout << "Software Updated successfully!" << endl;
-                updateInstalled = true;
-                writeUbootVarToEnv(ENV_USTATE, ustateVal.at(STATE_OK));
-        }
-}
-
-size_t MainWindow::setUpdateAvailableInUbootEnv(void) {
-        int ret;
-
-        if ((ret = libuboot_open(ubootCtx)) < 0) {
-		cout << "Cannot read environment" << endl;
-                return ret;
-	}
-
-        if (setUbootEnvVar(ENV_UPGRADE, "1") != 0) {
-                return -1;
-        }
-
-        if (writeUbootEnv == true) {
-                cout << "Writing u-boot env to memory." << endl;
-                writeUbootEnv = false;
-
-                ret = libuboot_env_store(ubootCtx);
-
-                if (ret) {
-                        cout << "Error storing the env" << endl;
-                        return -1;
-                }
-        }
-
-        libuboot_close(ubootCtx);
-
-        return 0;
-}
-
-bool MainWindow::hashAppData(std::string file, std::string& digest) {
-        EVP_MD_CTX *mdCtx;
-        const EVP_MD *mdAlg = EVP_get_digestbyname("SHA256");
-        unsigned char buf[HASH_CHUNK_SIZE];
-        unsigned char md[SHA256_DIGEST_LENGTH];
-        FILE *appData;
-        unsigned int cnt = 0;
-
-        std::stringstream hash;
-
-        appData = fopen(file.c_str(), "r");
+        hashProgressTimer.on_timeout([this]() {
+                appHash->text("computing... " + std::to_string(updater.hashPercent()) + "%");
+        });
 
-        if (!appData) {
-                cout << "Error opening app data file" << endl;
-                return false;
-        }
+        updater.onHashed([this](bool ok) {
+                hashProgressTimer.stop();
+                appHash->text(ok ? updater.appDataDigest().substr(0, 22) + " ..." : "unavailable");
+        });
 
-        mdCtx = EVP_MD_CTX_new();
-        if (!EVP_DigestInit_ex(mdCtx, mdAlg, NULL)) {
-                cout << "EVP_DigestInit failed" << endl;
-                EVP_MD_CTX_free(mdCtx);
-                return false;
-        }
+        updater.onCheckIn([this](bool ok) {
+                pollTime->text(getTime(updater.nextCheckIn()));
+        });
 
-        do {
-                cnt = fread(buf, 1, HASH_CHUNK_SIZE, appData);
-                if (!EVP_DigestUpdate(mdCtx, buf, cnt)) {
-                        cout << "EVP_DigestUpdate failed" << endl;
-                        EVP_MD_CTX_free(mdCtx);
-                        return false;
-                }
-        } while (cnt > 0);
-
-        unsigned int outlen;
-        if (!EVP_DigestFinal_ex(mdCtx, md, &cnt)) {
-                cout << "EVP_DigestFinal failed" << endl;
-                EVP_MD_CTX_free(mdCtx);
-                return false;
-        }
+        updater.onConfigReload([this, boardName, serialNum, hwVersion, swVersion]() {
+                std::string boardVer, serNum, hwVer, swVer;
 
-        EVP_MD_CTX_free(mdCtx);
+                updater.getAttrFromCfg("identify", "board", "value", boardVer);
+                updater.getAttrFromCfg("identify", "serial", "value", serNum);
+                updater.getAttrFromCfg("identify", "HW Version", "value", hwVer);
+                updater.getAttrFromCfg("identify", "SW Version", "value", swVer);
 
-        fclose(appData);
+                boardName->text(boardVer);
+                serialNum->text(serNum);
+                hwVersion->text(hwVer);
+                swVersion->text(swVer);
+        });
 
-        hash << std::hex << std::uppercase << std::setfill('0');
+        updater.onUpdateReady([this]() {
+                rebootWin.startRebootTimer(10);
+                rebootWin.show_modal(true);
+        });
 
-        for (const auto &c: md) {
-                hash << std::setw(2) << (int)c;
+        if (updater.hashing() == true) {
+                hashProgressTimer.start();
         }
 
-        digest = hash.str();
-
-        return true;
+        updater.start();
 }
 
-void MainWindow::getServerAttrs(void) {
-        std::string tenant, id;
-        getAttrFromCfg("suricatta", "url", uri);
-
-        // if we have an id field in the config object, then a config file was passed to the program
-        // construct URL from config file, otherwise, command line arguments were used and URL is fully formed
-        if (getAttrFromCfg("suricatta", "id", id) == true) {
-                getAttrFromCfg("suricatta", "tenant", tenant);
-                uri.append("/" + tenant + "/controller/v1/" + id);
-        }
-
-        if (uri.contains("https")) {
-                getAttrFromCfg("suricatta", "sslkey", sslkey);
-                getAttrFromCfg("suricatta", "sslcert", sslcert);
-        }
+MainWindow::~MainWindow() {
 }
 
 std::string MainWindow::getTime(void) {
@@ -502,125 +205,3 @@ std::string MainWindow::getTime(ssize_t future) {
 
         return ctime(&futureTime);
 }
-
-bool MainWindow::pollHawkbitServer(void) {
-        HTTP updateServer;
-        std::string res;
-
-        res = updateServer.get(uri, sslkey, sslcert);
-
-        auto updateServerJson = nlohmann::json::parse(res);
-
-        // check for config and get polling time
-        if (updateServerJson.contains("config")) {
-                const auto& config  = updateServerJson.at("config");
-
-                if (config.contains("polling")) {
-                        const auto& polling = config.at("polling");
-                        std::istringstream ss;
-                        std::tm t;
-
-                        ss.str(polling.at("sleep"));
-                        ss >> std::get_time(&t, "%H:%M:%S");
-                        serverPollTime = (t.tm_hour * 3600) + (t.tm_min * 60) + (t.tm_sec);
-                        //cout << "Next poll time is " << getTime(serverPollTime) << endl;
-                        pollTime->text(getTime(serverPollTime));
-                } else {
-                        cout << "Warning, did not get polling time from server, setting to default 5 minutes" << endl;
-                        serverPollTime = 300;
-                }
-
-        } else {
-                cout << "Error parsing JSON from server, no config node!" << endl;
-                return false;
-        }
-
-        if (updateServerJson.contains("_links")) {
-                if (updateServerJson["_links"].contains("deploymentBase")) {
-                        const auto& deploymentBase = updateServerJson.at("_links").at("deploymentBase");
-
-                        // get actionId
-                        std::string s = deploymentBase.at("href");
-                        unsigned start = s.find("deploymentBase/");
-                        unsigned startSize = std::string("deploymentBase/").size();
-                        unsigned startPos = start + startSize;
-                        unsigned end = s.find("?");
-
-                        std::string id = s.substr(startPos, end - startPos);
-
-                        actionId = stoi(id);
-
-                        // check if an update was recently installed or if one is available
-                        if (updateInstalled == false) {
-                                cout << "Update available with actionId: " << actionId << endl;
-                                updateAvailable = true;
-                        }
-                }
-        }
-
-        return true;
-}
-
-bool MainWindow::sendMsgToHawkbitServer(void) {
-        HTTP updateServer;
-
-        std::time_t time = std::time({});
-        char timeString[std::size("yyyy-mm-ddThh:mm:ss")];
-        std::strftime(std::data(timeString), std::size(timeString), "%FT%T", std::gmtime(&time));
-        std::string sTime(timeString);
-        std::erase(sTime, '-');
-        std::erase(sTime, ':');
-
-        json serverData = json::parse(R"(
-        {
-                "id": "",
-                "time": "",
-                "mode": "replace",
-                "status": {
-                        "result": {
-                                "finished": "success"
-                        },
-                        "execution": "closed",
-                        "details": [
-                                ""
-                        ]
-                },
-                "data": {
-                        "App Version": "",
-                        "SW Version": "",
-                        "HW Version": "",
-                        "serial": "",
-                        "board": ""
-                }
-        })");
-
-        serverData["time"] = sTime.c_str();
-        serverData["data"].at("App Version") = EGT_SWUPDATE_VERSION;
-
-        std::string val;
-
-        getAttrFromCfg("suricatta", "id", val);
-        serverData["id"] = val;
-
-        getAttrFromCfg("identify", "SW Version", "value", val);
-        serverData["data"].at("SW Version") = val;
-
-        getAttrFromCfg("identify", "HW Version", "value", val);
-        serverData["data"].at("HW Version") = val;
-
-        getAttrFromCfg("identify", "serial", "value", val);
-        serverData["data"].at("serial") = val;
-
-        getAttrFromCfg("identify", "board", "value", val);
-        serverData["data"].at("board") = val;
-
-        if (updateInstalled == true) {
-                updateInstalled = false;
-
-                // acknowledge update to Hawkbit server
-                return updateServer.post(uri + "/deploymentBase/" + std::to_string(actionId) + "/feedback", sslkey, sslcert, serverData.dump().c_str(), serverData.dump().size());
-        } else {
-                // send version info to Hawkbit server
-                return updateServer.put(uri + "/configData", sslkey, sslcert, serverData.dump().c_str(), serverData.dump().size());
-        }
-}
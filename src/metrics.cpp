@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include "metrics.h"
+
+using namespace std;
+
+// 1 ms to a minute, covers a DNS answer as well as hashing a large image
+static const std::vector<double> LATENCY_BUCKETS = {
+        0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+};
+
+Histogram::Histogram() : upper(LATENCY_BUCKETS), counts(LATENCY_BUCKETS.size() + 1, 0) {
+        total = 0;
+        valueSum = 0;
+}
+
+void Histogram::observe(double value) {
+        size_t i = std::lower_bound(upper.begin(), upper.end(), value) - upper.begin();
+
+        counts[i]++;
+        total++;
+        valueSum += value;
+}
+
+double Histogram::quantile(double q) const {
+        double rank = q * total;
+        size_t seen = 0;
+
+        if (total == 0) {
+                return 0;
+        }
+
+        for (size_t i = 0; i < upper.size(); i++) {
+                if (seen + counts[i] >= rank) {
+                        double lower = (i == 0) ? 0 : upper[i - 1];
+                        double within = counts[i] ? (rank - seen) / counts[i] : 0;
+
+                        return lower + (upper[i] - lower) * within;
+                }
+                seen += counts[i];
+        }
+
+        // in the +Inf bucket, the largest finite bound is all that is known
+        return upper.back();
+}
+
+Metrics& Metrics::instance(void) {
+        static Metrics metrics;
+
+        return metrics;
+}
+
+void Metrics::observe(const std::string& name, double seconds) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        histograms[name].observe(seconds);
+}
+
+void Metrics::add(const std::string& name, double value) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        counters[name] += value;
+}
+
+void Metrics::set(const std::string& name, double value) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        gauges[name] = value;
+}
+
+std::string Metrics::prometheus(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        std::ostringstream out;
+
+        for (const auto& c : counters) {
+                out << "# TYPE " << c.first << " counter\n" << c.first << " " << c.second << "\n";
+        }
+
+        for (const auto& g : gauges) {
+                out << "# TYPE " << g.first << " gauge\n" << g.first << " " << g.second << "\n";
+        }
+
+        for (const auto& h : histograms) {
+                const Histogram& hist = h.second;
+                size_t cumulative = 0;
+
+                out << "# TYPE " << h.first << " histogram\n";
+
+                for (size_t i = 0; i < hist.bounds().size(); i++) {
+                        cumulative += hist.buckets()[i];
+                        out << h.first << "_bucket{le=\"" << hist.bounds()[i] << "\"} " << cumulative << "\n";
+                }
+
+                out << h.first << "_bucket{le=\"+Inf\"} " << hist.count() << "\n";
+                out << h.first << "_sum " << hist.sum() << "\n";
+                out << h.first << "_count " << hist.count() << "\n";
+        }
+
+        return out.str();
+}
+
+bool Metrics::writeTextfile(const std::string& file) {
+        std::string tmp = file + ".tmp";
+        std::string text = prometheus();
+
+        // the collector must never see a half written file
+        {
+                std::ofstream out(tmp, std::ios::trunc);
+
+                out << text;
+                out.close();
+
+                if (!out) {
+                        cout << "Error writing metrics to " << tmp << endl;
+                        return false;
+                }
+        }
+
+        if (rename(tmp.c_str(), file.c_str()) != 0) {
+                cout << "Error renaming " << tmp << " to " << file << endl;
+                return false;
+        }
+
+        return true;
+}
+
+std::string Metrics::summary(const std::string& name) {
+        std::lock_guard<std::mutex> guard(lock);
+        char text[96];
+
+        auto h = histograms.find(name);
+
+        if (h != histograms.end()) {
+                snprintf(text, sizeof(text), "n %zu, p50 %.1f ms, p95 %.1f ms", h->second.count(),
+                         h->second.quantile(0.5) * 1000, h->second.quantile(0.95) * 1000);
+                return text;
+        }
+
+        auto c = counters.find(name);
+
+        if (c != counters.end()) {
+                snprintf(text, sizeof(text), "%.0f", c->second);
+                return text;
+        }
+
+        auto g = gauges.find(name);
+
+        if (g != gauges.end()) {
+                snprintf(text, sizeof(text), "%.1f", g->second);
+                return text;
+        }
+
+        return "-";
+}
+
+bool Metrics::value(const std::string& name, double& v) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto c = counters.find(name);
+
+        if (c != counters.end()) {
+                v = c->second;
+                return true;
+        }
+
+        auto g = gauges.find(name);
+
+        if (g != gauges.end()) {
+                v = g->second;
+                return true;
+        }
+
+        return false;
+}
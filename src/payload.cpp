@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "payload.h"
+
+// "yyyymmddThhmmss"
+#define TIME_WIDTH 15
+// "success" with its quotes, shorter results are padded with blanks
+#define RESULT_WIDTH 9
+
+static void appendEscaped(std::string& out, std::string_view s) {
+        out += '"';
+
+        for (char c : s) {
+                switch (c) {
+                case '"':
+                        out += "\\\"";
+                        break;
+                case '\\':
+                        out += "\\\\";
+                        break;
+                case '\n':
+                        out += "\\n";
+                        break;
+                case '\r':
+                        out += "\\r";
+                        break;
+                case '\t':
+                        out += "\\t";
+                        break;
+                default:
+                        if ((unsigned char) c < 0x20) {
+                                char esc[8];
+                                snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char) c);
+                                out += esc;
+                        } else {
+                                out += c;
+                        }
+                }
+        }
+
+        out += '"';
+}
+
+StatusPayload::StatusPayload() {
+        timePos = 0;
+        resultPos = 0;
+        dirty = true;
+        attrGeneration = 0;
+        numRebuilds = 0;
+}
+
+void StatusPayload::id(const std::string& id) {
+        if (id != devId) {
+                devId = id;
+                dirty = true;
+        }
+}
+
+void StatusPayload::attribute(const std::string& name, const std::string& value) {
+        auto it = attrs.find(name);
+
+        if ((it != attrs.end()) && (it->second == value)) {
+                return;
+        }
+
+        attrs[name] = value;
+        attrGeneration++;
+        dirty = true;
+}
+
+void StatusPayload::rebuild(void) {
+        buffer.clear();
+
+        buffer += "{\"id\":";
+        appendEscaped(buffer, devId);
+        buffer += ",\"time\":\"";
+        timePos = buffer.size();
+        buffer.append(TIME_WIDTH, '0');
+        buffer += "\",\"mode\":\"replace\",\"status\":{\"result\":{\"finished\":";
+        resultPos = buffer.size();
+        buffer.append(RESULT_WIDTH, ' ');
+        buffer += "},\"execution\":\"closed\",\"details\":[\"\"]},\"data\":{";
+
+        for (auto it = attrs.begin(); it != attrs.end(); it++) {
+                if (it != attrs.begin()) {
+                        buffer += ',';
+                }
+
+                appendEscaped(buffer, it->first);
+                buffer += ':';
+                appendEscaped(buffer, it->second);
+        }
+
+        buffer += "}}";
+
+        dirty = false;
+        numRebuilds++;
+}
+
+std::string_view StatusPayload::build(std::time_t now, const char *result) {
+        char timeString[TIME_WIDTH + 1];
+        struct tm tm;
+        size_t len = strlen(result);
+
+        if (dirty == true) {
+                rebuild();
+        }
+
+        gmtime_r(&now, &tm);
+        strftime(timeString, sizeof(timeString), "%Y%m%dT%H%M%S", &tm);
+        memcpy(&buffer[timePos], timeString, TIME_WIDTH);
+
+        // blanks between tokens are valid JSON, so the slot keeps its width
+        len = std::min(len, (size_t) RESULT_WIDTH - 2);
+        memset(&buffer[resultPos], ' ', RESULT_WIDTH);
+        buffer[resultPos] = '"';
+        memcpy(&buffer[resultPos + 1], result, len);
+        buffer[resultPos + 1 + len] = '"';
+
+        return buffer;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include "pollscheduler.h"
+
+using namespace std;
+
+typedef std::chrono::steady_clock clk;
+
+PollScheduler::PollScheduler(asio::io_context& io, Poll poll) : timer(io), poll(poll), config(defaults()), rng(std::random_device()()) {
+        // until the server tells otherwise
+        serverInterval = 300;
+        fastMode = false;
+        running = false;
+        pending = false;
+        failed = 0;
+        due = clk::now();
+}
+
+pollSettings_t PollScheduler::defaults(void) {
+        pollSettings_t s;
+
+        s.jitter = POLL_JITTER;
+        s.retryMin = POLL_RETRY_MIN;
+        s.retryMax = POLL_RETRY_MAX;
+        s.fastInterval = POLL_FAST;
+        s.startSpread = POLL_START_SPREAD;
+
+        return s;
+}
+
+void PollScheduler::start(void) {
+        // devices that power up together should not all check in at once
+        arm(uniform(0, std::max(config.startSpread, (ssize_t) 0)));
+}
+
+void PollScheduler::stop(void) {
+        timer.cancel();
+        pending = false;
+}
+
+void PollScheduler::now(void) {
+        if (running == true) {
+                pending = true;
+                return;
+        }
+
+        arm(0);
+}
+
+ssize_t PollScheduler::next(void) const {
+        if (running == true) {
+                return 0;
+        }
+
+        return std::max((ssize_t) 0, (ssize_t) std::chrono::duration_cast<std::chrono::seconds>(due - clk::now()).count());
+}
+
+void PollScheduler::arm(double seconds) {
+        due = clk::now() + std::chrono::microseconds((long long) (seconds * 1e6));
+
+        timer.expires_at(due);
+        timer.async_wait([this](const asio::error_code& ec) {
+                if (!ec) {
+                        fire();
+                }
+        });
+}
+
+void PollScheduler::fire(void) {
+        running = true;
+
+        poll([this](bool ok, long status, ssize_t retryAfter) {
+                finished(ok, status, retryAfter);
+        });
+}
+
+void PollScheduler::finished(bool ok, long status, ssize_t retryAfter) {
+        ssize_t period = std::max(serverInterval, (ssize_t) 1);
+        double j = std::clamp(config.jitter, (ssize_t) 0, (ssize_t) 100) / 100.0;
+        double delay;
+
+        running = false;
+
+        if (fastMode == true) {
+                period = std::min(period, std::max(config.fastInterval, (ssize_t) 1));
+        }
+
+        if (ok == true) {
+                failed = 0;
+                delay = period * uniform(1 - j, 1 + j);
+        } else {
+                double backoff = std::max(config.retryMin, (ssize_t) 1) * std::pow(2.0, std::min(failed, (size_t) 20));
+
+                failed++;
+                backoff = std::min(backoff, (double) std::max(config.retryMax, config.retryMin));
+
+                // the devices that failed together retry spread over the
+                // upper half of the backoff
+                delay = uniform(backoff / 2, backoff);
+
+                // an overloaded server is never polled faster than usual
+                if ((status == 429) || (status == 503)) {
+                        delay = std::max({delay, (double) retryAfter, period * uniform(1, 1 + j)});
+                }
+
+                cout << "Check-in failed";
+                if (status != 0) {
+                        cout << " with HTTP " << status;
+                }
+                cout << ", " << failed << " in a row, retrying in " << (ssize_t) delay << " s" << endl;
+        }
+
+        // a queued request doesn't get around the backoff, the retry is
+        // the follow-up check-in
+        if ((pending == true) && (ok == true)) {
+                delay = 0;
+        }
+
+        pending = false;
+
+        arm(delay);
+}
+
+double PollScheduler::uniform(double from, double to) {
+        if (to <= from) {
+                return from;
+        }
+
+        return std::uniform_real_distribution<double>(from, to)(rng);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstdio>
+#include "statusbar.h"
+
+using namespace std;
+using namespace egt;
+
+// wide enough for "hh:mm:ss" and "CPU: 100%" at 24 pt, and for the
+// statistics at 14 pt
+#define TIME_WIDTH 130
+#define CPU_WIDTH 300
+#define STATUS_STATS_INTERVAL 10
+
+static double elapsedMs(const struct timespec& from, const struct timespec& to) {
+        return (to.tv_sec - from.tv_sec) * 1000.0 + (to.tv_nsec - from.tv_nsec) / 1e6;
+}
+
+StatusBar::StatusBar(const std::string& title) :
+        Frame(Size(0, 60)),
+        appName(egt::Image("icon:cancel.png"), title),
+        clockSizer(Orientation::horizontal),
+        dateLabel("", AlignFlag::center),
+        timeLabel("", Rect(0, 0, TIME_WIDTH, 50), AlignFlag::left),
+        cpuLabel("CPU:---", Rect(0, 0, CPU_WIDTH, 30), AlignFlag::right),
+        statsLabel("", Rect(0, 0, CPU_WIDTH, 20), AlignFlag::right) {
+        numRedraws = 0;
+        numUnchanged = 0;
+        ticks = 0;
+
+        fill_flags(Theme::FillFlag::blend);
+        height(50);
+
+        appName.color(Palette::ColorId::bg, Palette::transparent);
+        appName.align(AlignFlag::left | AlignFlag::center_vertical);
+        appName.image_align(AlignFlag::right);
+        appName.margin(10);
+        appName.font(egt::Font(24));
+        add(appName);
+
+        for (Label *l : {&dateLabel, &timeLabel, &cpuLabel}) {
+                l->color(Palette::ColorId::bg, Palette::transparent);
+                l->margin(10);
+                l->font(egt::Font(24));
+        }
+
+        clockSizer.color(Palette::ColorId::bg, Palette::transparent);
+        clockSizer.align(AlignFlag::center_horizontal | AlignFlag::center_vertical);
+        clockSizer.add(dateLabel);
+        clockSizer.add(timeLabel);
+        add(clockSizer);
+
+        cpuLabel.align(AlignFlag::right | AlignFlag::top);
+        add(cpuLabel);
+
+        statsLabel.color(Palette::ColorId::bg, Palette::transparent);
+        statsLabel.margin(2);
+        statsLabel.font(egt::Font(14));
+        statsLabel.align(AlignFlag::right | AlignFlag::bottom);
+        add(statsLabel);
+
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &lastCpu);
+        clock_gettime(CLOCK_MONOTONIC, &lastWall);
+
+        refresh();
+
+        timer = PeriodicTimer(std::chrono::seconds(1));
+        timer.on_timeout([this]() {
+                refresh();
+        });
+        timer.start();
+}
+
+void StatusBar::provisioned(bool p) {
+        appName.image(egt::Image(p ? "icon:ok.png" : "icon:cancel.png"));
+}
+
+void StatusBar::setText(Label& label, std::string& shown, const char *text) {
+        if (shown == text) {
+                numUnchanged++;
+                return;
+        }
+
+        shown = text;
+        label.text(shown);
+        numRedraws++;
+}
+
+void StatusBar::refresh(void) {
+        char text[64];
+        std::time_t now = std::time(nullptr);
+        struct timespec cpuNow, wallNow;
+        struct tm tm;
+
+        localtime_r(&now, &tm);
+
+        strftime(text, sizeof(text), "%a %b %e %Y", &tm);
+        setText(dateLabel, dateShown, text);
+
+        strftime(text, sizeof(text), "%H:%M:%S", &tm);
+        setText(timeLabel, timeShown, text);
+
+        cpuMon.update();
+        snprintf(text, sizeof(text), "CPU: %d%%", static_cast<int>(cpuMon.usage()));
+        setText(cpuLabel, cpuShown, text);
+
+        // averaged over the interval, the label stays empty until then
+        if ((++ticks % STATUS_STATS_INTERVAL) != 0) {
+                return;
+        }
+
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuNow);
+        clock_gettime(CLOCK_MONOTONIC, &wallNow);
+
+        double wall = elapsedMs(lastWall, wallNow);
+        double used = (wall > 0) ? elapsedMs(lastCpu, cpuNow) * 1000.0 / wall : 0;
+
+        lastCpu = cpuNow;
+        lastWall = wallNow;
+
+        snprintf(text, sizeof(text), "%.1f ms/s, %zu redraws, %zu unchanged", used, numRedraws, numUnchanged);
+        setText(statsLabel, statsShown, text);
+}
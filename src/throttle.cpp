@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "throttle.h"
+
+using namespace std;
+
+// from linux/ioprio.h, which not every toolchain ships
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+Throttle::Throttle(asio::io_context& io, HTTP& http) : timer(io), http(http) {
+        config = {0, 0, true};
+        running = false;
+        isPaused = false;
+        numPauses = 0;
+        lastBusy = 0;
+        lastTotal = 0;
+}
+
+void Throttle::settings(const throttleSettings_t& s) {
+        config = s;
+        http.recvLimit(config.rate);
+}
+
+void Throttle::start(void) {
+        if ((running == true) || (config.idleLoad <= 0)) {
+                return;
+        }
+
+        running = true;
+        load();
+        sample();
+}
+
+void Throttle::stop(void) {
+        running = false;
+        timer.cancel();
+
+        if (isPaused == true) {
+                isPaused = false;
+                http.pauseDownload(false);
+        }
+}
+
+void Throttle::sample(void) {
+        timer.expires_after(std::chrono::milliseconds(THROTTLE_SAMPLE_MS));
+        timer.async_wait([this](const asio::error_code& ec) {
+                if (ec || (running == false)) {
+                        return;
+                }
+
+                int usage = load();
+
+                if ((isPaused == false) && (usage > config.idleLoad)) {
+                        isPaused = true;
+                        numPauses++;
+                        http.pauseDownload(true);
+                } else if ((isPaused == true) && (usage < config.idleLoad - THROTTLE_HYSTERESIS)) {
+                        isPaused = false;
+                        http.pauseDownload(false);
+                }
+
+                sample();
+        });
+}
+
+int Throttle::load(void) {
+        std::ifstream stat("/proc/stat");
+        std::string cpu;
+        uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+
+        if (!(stat >> cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal) || (cpu != "cpu")) {
+                return 0;
+        }
+
+        uint64_t busy = user + nice + system + irq + softirq + steal;
+        uint64_t total = busy + idle + iowait;
+        uint64_t dTotal = total - lastTotal;
+        int usage = dTotal ? (int) (((busy - lastBusy) * 100) / dTotal) : 0;
+
+        lastBusy = busy;
+        lastTotal = total;
+
+        return usage;
+}
+
+void Throttle::background(void) {
+        struct sched_param param = {};
+
+        // pid 0 is the calling thread for both
+        if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+                cout << "Cannot switch worker thread to SCHED_IDLE" << endl;
+        }
+
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+                cout << "Cannot switch worker thread to idle I/O priority" << endl;
+        }
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include "libuboot.h"
+#include "ubootenv.h"
+#include "metrics.h"
+
+using namespace std;
+
+UbootEnv::UbootEnv() {
+        ctx = NULL;
+        state = 0;
+        txn = false;
+        dirty.fill(false);
+}
+
+size_t UbootEnv::init(const std::string& config) {
+        int ret = 0;
+        const char *ns;
+
+        ret = libuboot_read_config_ext(&ctx, config.c_str());
+
+        if (ret) {
+		cout << "Cannot initialize u-boot env" << endl;
+                return -1;
+	}
+
+	ns = libuboot_namespace_from_dt();
+
+        if (ns) {
+                ctx = libuboot_get_namespace(ctx, ns);
+        }
+
+	if (!ctx) {
+		cout << "Namespace not found" << endl;
+		return -1;
+	}
+
+	if ((ret = libuboot_open(ctx)) < 0) {
+		cout << "Cannot read environment" << endl;
+                return -1;
+	}
+
+        // everything later works on this copy, the env is only opened
+        // again to store a committed transaction
+        for (size_t var = 0; var < ENV_MAX; var++) {
+                const char *value = libuboot_get_env(ctx, ubootEnvVars.at(var).c_str());
+
+                stored.at(var) = value ? value : "";
+        }
+
+        libuboot_close(ctx);
+
+        shadow = stored;
+        dirty.fill(false);
+
+        try {
+                state = stoi(stored.at(ENV_USTATE));
+        } catch (const std::exception& e) {
+                cout << "Invalid ustate '" << stored.at(ENV_USTATE) << "'" << endl;
+                state = 0;
+        }
+
+        return 0;
+}
+
+void UbootEnv::begin(void) {
+        if (txn == true) {
+                cout << "Discarding unfinished u-boot env transaction" << endl;
+                abort();
+        }
+
+        txn = true;
+}
+
+size_t UbootEnv::set(ubootEnvVars_t var, std::string val) {
+        if (txn != true) {
+                cout << "Setting " << ubootEnvVars.at(var) << " outside of a transaction" << endl;
+                return -1;
+        }
+
+        if (shadow.at(var) == val) {
+                cout << "Not setting " << ubootEnvVars.at(var) << ", value is the same." << endl;
+                return 0;
+        }
+
+        cout << "Setting " << ubootEnvVars.at(var) << " to " << val << endl;
+
+        shadow.at(var) = val;
+        dirty.at(var) = (shadow.at(var) != stored.at(var));
+
+        return 0;
+}
+
+size_t UbootEnv::commit(void) {
+        int ret;
+
+        if (txn != true) {
+                cout << "No u-boot env transaction to commit" << endl;
+                return -1;
+        }
+
+        txn = false;
+
+        if (std::find(dirty.begin(), dirty.end(), true) == dirty.end()) {
+                return 0;
+        }
+
+        if (!ctx) {
+                cout << "u-boot env is not initialized" << endl;
+                shadow = stored;
+                dirty.fill(false);
+                return -1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        if ((ret = libuboot_open(ctx)) < 0) {
+		cout << "Cannot read environment" << endl;
+                shadow = stored;
+                dirty.fill(false);
+                return -1;
+	}
+
+        for (size_t var = 0; var < ENV_MAX; var++) {
+                if (dirty.at(var) != true) {
+                        continue;
+                }
+
+                ret = libuboot_set_env(ctx, ubootEnvVars.at(var).c_str(), shadow.at(var).c_str());
+
+                if (ret) {
+                        cout << "libuboot_set_env failed: " << ret << endl;
+                        break;
+                }
+        }
+
+        if (ret == 0) {
+                cout << "Writing u-boot env to memory." << endl;
+
+                ret = libuboot_env_store(ctx);
+
+                if (ret) {
+                        cout << "Error storing the env" << endl;
+                }
+        }
+
+        libuboot_close(ctx);
+
+        Metrics::instance().observe("egt_swupdate_env_store_seconds",
+                                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        if (ret) {
+                Metrics::instance().add("egt_swupdate_env_store_errors_total");
+        }
+
+        // on failure the shadow goes back to what is known to be stored
+        if (ret) {
+                shadow = stored;
+        } else {
+                stored = shadow;
+        }
+
+        dirty.fill(false);
+
+        return ret ? -1 : 0;
+}
+
+void UbootEnv::abort(void) {
+        shadow = stored;
+        dirty.fill(false);
+        txn = false;
+}
+
+size_t UbootEnv::write(ubootEnvVars_t var, std::string val) {
+        begin();
+
+        if (set(var, val) != 0) {
+                abort();
+                return -1;
+        }
+
+        return commit();
+}
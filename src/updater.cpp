@@ -0,0 +1,727 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <ctime>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "updater.h"
+#include "metrics.h"
+
+using namespace std;
+
+// pkcs11: URIs name a key or certificate in a token, not a file
+static bool credentialIsFile(const std::string& credential) {
+        return strncasecmp(credential.c_str(), "pkcs11:", 7) != 0;
+}
+
+Updater::Updater(asio::io_context& io, std::string const cfg) :
+        io(io), swupdateCfg(io), httpLoop(io), updateServer(&httpLoop), pollScheduler(io, [this](PollScheduler::Result done) { pollCycle(done); }),
+        slotWriter(io), credentialWatch(io), throttle(io, updateServer) {
+        hashPending = false;
+        isProvisioned = false;
+        provisionWaiting = false;
+        credentialsUnwatched = false;
+        checkedIn = false;
+        deploying = false;
+        updateStaged = false;
+        hashVerifying = false;
+        checkInWaiting = false;
+        digestCacheParanoid = false;
+        appDataChanged = "none";
+
+        readConfigFile(cfg);
+        // before the hash worker that reads it starts
+        getThrottleAttrs();
+
+        appDataFile = std::string("/opt/data/app_data.img");
+        getAttrFromCfg("egt_swupdate", "app_data", appDataFile);
+        getHashAttrs();
+        startAppDataHash();
+
+        ubootEnv.init();
+        getServerAttrs();
+
+        std::string id;
+        getAttrFromCfg("suricatta", "id", id);
+        controller = std::make_unique<Controller>(updateServer, uri, sslkey, sslcert, id, &ubootEnv);
+        controller->checkIfUpdated();
+
+        std::string downloadDir("/var/tmp/egt-swupdate");
+        getAttrFromCfg("egt_swupdate", "download_dir", downloadDir);
+        fetcher = std::make_unique<DeploymentFetcher>(updateServer, downloadDir);
+
+        // compressed artifacts needing a larger window are refused, so an
+        // update can't take the memory the application needs
+        int windowMB = DECOMPRESS_WINDOW_MB, unpackThreads = 0;
+        getAttrFromCfg("egt_swupdate", "decompress_window", windowMB);
+        getAttrFromCfg("egt_swupdate", "decompress_threads", unpackThreads);
+        fetcher->decompression(std::max(windowMB, 1), std::max(unpackThreads, 0));
+
+        // delta artifacts are rebuilt against appDataFile into this image,
+        // there is no default: a rebuilt image in the download directory
+        // would never be booted
+        getAttrFromCfg("egt_swupdate", "app_data_slot", appDataSlot);
+
+        getInstallAttrs();
+
+        getPollAttrs();
+
+        // Prometheus text file, written after every check-in
+        getAttrFromCfg("egt_swupdate", "metrics_file", metricsFile);
+
+        getIdentifyAttrs();
+        watchCredentials();
+
+        swupdateCfg.watch([this]() {
+                configReloaded();
+        });
+}
+
+Updater::~Updater() {
+        if (hashWorker.joinable()) {
+                hashWorker.join();
+        }
+
+        if (deltaWorker.joinable()) {
+                deltaWorker.join();
+        }
+}
+
+void Updater::start(void) {
+        // runs once the event loop is up, after the front end is set up
+        asio::post(io, []() {
+                footprint("event loop start");
+        });
+
+        // the app data digest is part of the reported attributes, so the
+        // first check-in waits for it
+        if (hashPending == true) {
+                checkInWaiting = true;
+        } else {
+                firstCheckIn();
+        }
+}
+
+void Updater::firstCheckIn(void) {
+        // without its certificate the device can't authenticate, the watch
+        // checks in as soon as it is provisioned
+        if ((sslcert.empty() != true) && (isProvisioned == false) && (credentialsUnwatched == false)) {
+                cout << "Waiting for " << certFile << " before checking in" << endl;
+                provisionWaiting = true;
+                return;
+        }
+
+        pollScheduler.start();
+}
+
+void Updater::pollCycle(PollScheduler::Result done) {
+        auto start = std::chrono::steady_clock::now();
+
+        checkIn([this, done, start](bool ok) {
+                Metrics& m = Metrics::instance();
+
+                m.observe("egt_swupdate_checkin_seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                m.add(ok ? "egt_swupdate_checkins_total" : "egt_swupdate_checkin_failures_total");
+
+                if (checkedIn == false) {
+                        checkedIn = true;
+                        footprint("first check-in");
+                }
+
+                cout << "Hawkbit requests: " << updateServer.requests() << ", TLS handshakes avoided: " << updateServer.handshakesAvoided() << endl;
+
+                if ((ok == true) && (controller->updateAvailable() == true) && (updateStaged == false) && (deploying == false)) {
+                        fetchDeployment();
+                }
+
+                // poll faster until the deployment is downloaded and staged
+                pollScheduler.interval(controller->pollInterval());
+                pollScheduler.fast(deploying);
+                done(ok, controller->status(), controller->retryAfter());
+
+                m.set("egt_swupdate_poll_interval_seconds", controller->pollInterval());
+                m.set("egt_swupdate_poll_consecutive_failures", pollScheduler.failures());
+
+                if (metricsFile.empty() != true) {
+                        m.writeTextfile(metricsFile);
+                }
+
+                if (checkInHandler) {
+                        checkInHandler(ok);
+                }
+        });
+}
+
+void Updater::fetchDeployment(void) {
+        deploying = true;
+        throttle.start();
+
+        fetcher->fetch(controller->deploymentBase(), sslkey, sslcert, [this](bool ok) {
+                throttle.stop();
+
+                if (ok != true) {
+                        cout << "Error fetching deployment, not rebooting" << endl;
+                        deploying = false;
+                        return;
+                }
+
+                applyDeltas([this](bool ok) {
+                        deploying = false;
+
+                        if (ok != true) {
+                                cout << "Error applying app data delta, not rebooting" << endl;
+                        } else if (controller->markUpdateAvailable(fetcher->installed() ? installSlot : "") != 0) {
+                                cout << "Error setting u-boot env, not rebooting" << endl;
+                        } else {
+                                updateStaged = true;
+
+                                if (updateReadyHandler) {
+                                        updateReadyHandler();
+                                } else {
+                                        cout << "Update staged, it is installed on the next reboot" << endl;
+                                }
+                        }
+                });
+        });
+}
+
+void Updater::checkIn(Completion done) {
+        // the digest may have been computed since the last check-in
+        controller->attribute("App Data Hash", appDataMd);
+        controller->attribute("App Data Changed Blocks", appDataChanged);
+
+        controller->checkIn(done);
+}
+
+void Updater::startAppDataHash(void) {
+        struct stat st;
+
+        hashProgress = 0;
+        hashTotal = (stat(appDataFile.c_str(), &st) == 0) ? st.st_size : 0;
+
+        if (digestCache.lookup(appDataFile, hashTag, appDataMd) == true) {
+                cout << "App data unchanged since it was last hashed, using cached digest" << endl;
+
+                if (digestCacheParanoid != true) {
+                        return;
+                }
+
+                // keep the cached digest but check it in the background
+                hashVerifying = true;
+        } else {
+                hashPending = true;
+        }
+
+        hashWorker = std::thread([this, verify = hashVerifying, idle = hashVerifying && throttle.idlePriority()]() {
+                std::string digest, changed;
+
+                // nothing waits for a check of the cached digest
+                if (idle == true) {
+                        Throttle::background();
+                }
+
+                fileIdentity_t id;
+                bool identified = digestCache.identify(appDataFile, id);
+                auto start = std::chrono::steady_clock::now();
+                bool ok = hashAppData(appDataFile, digest, changed, verify);
+
+                Metrics::instance().observe("egt_swupdate_app_data_hash_seconds",
+                                            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+                if ((ok == true) && (identified == true)) {
+                        digestCache.store(appDataFile, hashTag, id, digest);
+                }
+
+                // hand the result over to the event loop
+                asio::post(io, [this, ok, digest, changed]() {
+                        appDataHashed(ok, digest, changed);
+                });
+        });
+}
+
+void Updater::appDataHashed(bool ok, std::string digest, std::string changed) {
+        hashWorker.join();
+        hashPending = false;
+
+        if (ok == true) {
+                appDataChanged = changed;
+        }
+
+        if (hashVerifying == true) {
+                hashVerifying = false;
+
+                if ((ok == true) && (digest != appDataMd)) {
+                        cout << "Cached app data digest was stale, " << appDataMd << " is now " << digest << endl;
+                        appDataMd = digest;
+
+                        if (hashedHandler) {
+                                hashedHandler(true);
+                        }
+                }
+                return;
+        }
+
+        if (ok == true) {
+                appDataMd = digest;
+        }
+
+        if (hashedHandler) {
+                hashedHandler(ok);
+        }
+
+        if (checkInWaiting == true) {
+                checkInWaiting = false;
+                firstCheckIn();
+        }
+}
+
+bool Updater::readConfigFile(std::string cfgFile) {
+        return swupdateCfg.load(cfgFile);
+}
+
+bool Updater::getAttrFromCfg(std::string node, std::string attr, std::string& val) {
+        return swupdateCfg.get(node, attr, val);
+}
+
+bool Updater::getAttrFromCfg(std::string node, std::string attr, int& val) {
+        return swupdateCfg.get(node, attr, val);
+}
+
+bool Updater::getAttrFromCfg(std::string node, std::string attr, bool& val) {
+        return swupdateCfg.get(node, attr, val);
+}
+
+bool Updater::getAttrFromCfg(std::string node, std::string subnode, std::string key, std::string& val) {
+        return swupdateCfg.get(node, subnode, key, val);
+}
+
+void Updater::getHashAttrs(void) {
+        std::string mode;
+        hashMode_t hashMode = HASH_FLAT;
+        int blockSize = HASH_BLOCK_SIZE;
+        int threads = 0;
+
+        if (getAttrFromCfg("egt_swupdate", "hash_mode", mode) == true) {
+                if (HashEngine::parseMode(mode, hashMode) != true) {
+                        cout << "Unknown hash mode " << mode << ", using flat SHA-256" << endl;
+                }
+        }
+
+        getAttrFromCfg("egt_swupdate", "hash_block_size", blockSize);
+        getAttrFromCfg("egt_swupdate", "hash_threads", threads);
+
+        hashEngine = HashEngine(hashMode, std::max(blockSize, 0), std::max(threads, 0));
+
+        std::string cachePath("/var/lib/egt-swupdate/digest.cache");
+        std::string verityRoot;
+        bool sample = true;
+
+        getAttrFromCfg("egt_swupdate", "digest_cache", cachePath);
+        getAttrFromCfg("egt_swupdate", "digest_cache_sample", sample);
+        getAttrFromCfg("egt_swupdate", "digest_cache_paranoid", digestCacheParanoid);
+        getAttrFromCfg("egt_swupdate", "app_data_verity_root", verityRoot);
+
+        digestCache = DigestCache(cachePath, sample);
+
+        // an empty path turns the block index off
+        std::string indexPath("/var/lib/egt-swupdate/blocks.idx");
+
+        getAttrFromCfg("egt_swupdate", "block_index", indexPath);
+
+        blockIndex = BlockIndex(indexPath);
+
+        // a digest is only valid for the settings it was computed with
+        hashTag = HashEngine::modeName(hashEngine.mode()) + ":" + std::to_string(hashEngine.blockSize());
+        if (verityRoot.empty() != true) {
+                hashTag += ":" + verityRoot;
+        }
+}
+
+void Updater::getPollAttrs(void) {
+        pollSettings_t s = PollScheduler::defaults();
+        int val;
+
+        if (getAttrFromCfg("egt_swupdate", "poll_jitter", val) == true) {
+                s.jitter = val;
+        }
+        if (getAttrFromCfg("egt_swupdate", "poll_retry_min", val) == true) {
+                s.retryMin = val;
+        }
+        if (getAttrFromCfg("egt_swupdate", "poll_retry_max", val) == true) {
+                s.retryMax = val;
+        }
+        if (getAttrFromCfg("egt_swupdate", "poll_fast", val) == true) {
+                s.fastInterval = val;
+        }
+        if (getAttrFromCfg("egt_swupdate", "poll_start_spread", val) == true) {
+                s.startSpread = val;
+        }
+
+        pollScheduler.settings(s);
+}
+
+void Updater::getThrottleAttrs(void) {
+        throttleSettings_t s = {0, 0, true};
+        int val;
+
+        if (getAttrFromCfg("egt_swupdate", "download_rate", val) == true) {
+                s.rate = std::max(val, 0);
+        }
+        if (getAttrFromCfg("egt_swupdate", "download_idle_load", val) == true) {
+                s.idleLoad = std::clamp(val, 0, 100);
+        }
+        getAttrFromCfg("egt_swupdate", "background_idle", s.idlePriority);
+
+        throttle.settings(s);
+}
+
+void Updater::getInstallAttrs(void) {
+        std::string slotA, slotB, booted;
+        bool readback = true;
+
+        getAttrFromCfg("egt_swupdate", "slot_a", slotA);
+        getAttrFromCfg("egt_swupdate", "slot_b", slotB);
+        getAttrFromCfg("egt_swupdate", "install_readback", readback);
+        slotWriter.readback(readback);
+
+        if (slotA.empty() || slotB.empty()) {
+                return;
+        }
+
+        // u-boot knows which slot it booted, the root device is the fallback
+        booted = ubootEnv.get(ENV_SLOT);
+
+        if (booted.empty()) {
+                booted = SlotWriter::active(slotB) ? "b" : "a";
+        }
+
+        installSlot = (booted == "b") ? "a" : "b";
+        fetcher->install(&slotWriter, (installSlot == "a") ? slotA : slotB);
+
+        cout << "Booted from slot " << booted << ", updates are installed into slot " << installSlot << endl;
+}
+
+bool Updater::hashAppData(std::string file, std::string& digest, std::string& changed, bool verify) {
+        // whatever the engine last read, the whole file or the blocks the
+        // index needed, is what the rate is measured on
+        auto report = [this]() {
+                cout << "Hashed " << hashEngine.bytes() << " bytes of app data in " << hashEngine.seconds() << " s ("
+                     << hashEngine.throughput() << " MB/s, " << HashEngine::modeName(hashEngine.mode()) << ", "
+                     << hashEngine.blockSize() << " byte blocks)" << endl;
+
+                Metrics::instance().set("egt_swupdate_app_data_hash_bytes_per_second", hashEngine.throughput() * 1024 * 1024);
+        };
+
+        changed = "none";
+
+        if (blockIndex.enabled() == true) {
+                bool tree = (hashEngine.mode() == HASH_TREE);
+
+                // the index holds every leaf digest and, in flat mode, the
+                // digest of the whole file: an unchanged file is not read at
+                // all and a changed one only once. A check of the cached
+                // digest reads it anyway and checks the index on the way.
+                if (blockIndex.update(file, hashEngine, &hashProgress, verify) == true) {
+                        if (blockIndex.changed().empty() != true) {
+                                changed = BlockIndex::ranges(blockIndex.changed(), HAWKBIT_VALUE_MAX);
+                        }
+
+                        cout << "Rehashed " << blockIndex.rehashed() << " app data blocks, "
+                             << blockIndex.changed().size() << " changed" << endl;
+
+                        // nothing was read when the file is unchanged, the
+                        // last measurement still stands
+                        if (blockIndex.rehashed() > 0) {
+                                report();
+                        }
+
+                        if ((tree ? blockIndex.root(digest) : blockIndex.flat(digest)) == true) {
+                                return true;
+                        }
+                } else {
+                        cout << "Error updating app data block index" << endl;
+                        hashProgress = 0;
+                }
+        }
+
+        if (hashEngine.hashFile(file, digest, &hashProgress) != true) {
+                cout << "Error hashing app data file" << endl;
+                return false;
+        }
+
+        report();
+
+        return true;
+}
+
+void Updater::applyDeltas(std::function<void(bool)> done) {
+        std::vector<std::string> deltas;
+
+        for (const auto& artifact : fetcher->artifacts()) {
+                if (Decompressor::strip(artifact.filename).ends_with(DELTA_SUFFIX)) {
+                        deltas.push_back(fetcher->path(artifact));
+                }
+        }
+
+        if (deltas.empty()) {
+                done(true);
+                return;
+        }
+
+        if (deltas.size() > 1) {
+                cout << "Only one app data delta per deployment is supported" << endl;
+                done(false);
+                return;
+        }
+
+        if (appDataSlot.empty()) {
+                cout << "Refusing app data delta, egt_swupdate.app_data_slot is not configured" << endl;
+                done(false);
+                return;
+        }
+
+        std::error_code ec;
+        if (std::filesystem::equivalent(appDataSlot, appDataFile, ec)) {
+                cout << "Refusing app data delta, app_data_slot is the app data image it is built against" << endl;
+                done(false);
+                return;
+        }
+
+        // rebuilding and verifying the image reads it all, keep that off
+        // the event loop
+        deltaWorker = std::thread([this, delta = deltas.front(), done, idle = throttle.idlePriority()]() {
+                if (idle == true) {
+                        Throttle::background();
+                }
+
+                bool ok = applyDelta(delta);
+
+                asio::post(io, [this, ok, done]() {
+                        deltaWorker.join();
+                        done(ok);
+                });
+        });
+}
+
+bool Updater::applyDelta(std::string delta) {
+        DeltaPatcher patcher;
+        HashEngine engine(HASH_FLAT, hashEngine.blockSize(), hashEngine.threads());
+        std::string digest;
+        struct stat st;
+
+        size_t deltaSize = (stat(delta.c_str(), &st) == 0) ? st.st_size : 0;
+
+        // the delta must have been built against exactly this image. A
+        // digest the cache or the index still vouches for saves reading it;
+        // the hash worker may be updating the index, so it is loaded afresh.
+        std::string source;
+
+        if ((hashEngine.mode() != HASH_FLAT) || (digestCache.lookup(appDataFile, hashTag, source) != true)) {
+                if ((BlockIndex(blockIndex.path()).lookup(appDataFile, source) != true) &&
+                    (engine.hashFile(appDataFile, source) != true)) {
+                        return false;
+                }
+        }
+
+        if (patcher.apply(delta, appDataFile, appDataSlot, source) != true) {
+                return false;
+        }
+
+        if (engine.hashFile(appDataSlot, digest) != true) {
+                return false;
+        }
+
+        if (strcasecmp(digest.c_str(), patcher.targetSha256().c_str()) != 0) {
+                cout << "SHA-256 mismatch for rebuilt app data: got " << digest << ", expected " << patcher.targetSha256() << endl;
+                return false;
+        }
+
+        cout << "Rebuilt " << appDataSlot << " from a " << deltaSize << " byte delta (" << patcher.copied() << " bytes reused, "
+             << patcher.literal() << " bytes received)" << endl;
+
+        // once it is the app data image, the index only rehashes what moved
+        blockIndex.hint(appDataFile, appDataSlot, digest, patcher.changed());
+
+        unlink(delta.c_str());
+
+        return true;
+}
+
+void Updater::getServerAttrs(void) {
+        std::string tenant, id;
+
+        uri.clear();
+        sslkey.clear();
+        sslcert.clear();
+        getAttrFromCfg("suricatta", "url", uri);
+
+        // if we have an id field in the config object, then a config file was passed to the program
+        // construct URL from config file, otherwise, command line arguments were used and URL is fully formed
+        if (getAttrFromCfg("suricatta", "id", id) == true) {
+                getAttrFromCfg("suricatta", "tenant", tenant);
+                uri.append("/" + tenant + "/controller/v1/" + id);
+        }
+
+        if (uri.contains("https")) {
+                getAttrFromCfg("suricatta", "sslkey", sslkey);
+                getAttrFromCfg("suricatta", "sslcert", sslcert);
+        }
+}
+
+void Updater::getIdentifyAttrs(void) {
+        std::string boardVer, serNum, hwVer, swVer;
+
+        getAttrFromCfg("identify", "board", "value", boardVer);
+        getAttrFromCfg("identify", "serial", "value", serNum);
+        getAttrFromCfg("identify", "HW Version", "value", hwVer);
+        getAttrFromCfg("identify", "SW Version", "value", swVer);
+
+        controller->attribute("App Version", EGT_SWUPDATE_VERSION);
+        controller->attribute("SW Version", swVer);
+        controller->attribute("HW Version", hwVer);
+        controller->attribute("serial", serNum);
+        controller->attribute("board", boardVer);
+}
+
+void Updater::watchCredentials(void) {
+        certFile.clear();
+        keyFile.clear();
+        getAttrFromCfg("suricatta", "sslcert", certFile);
+        getAttrFromCfg("suricatta", "sslkey", keyFile);
+
+        credentialWatch.clear();
+        credentialWatch.onChanged([this]() {
+                credentialsChanged();
+        });
+
+        credentialsUnwatched = false;
+
+        for (const auto& file : {certFile, keyFile}) {
+                if ((file.empty() != true) && credentialIsFile(file) && (credentialWatch.add(file) != true)) {
+                        credentialsUnwatched = true;
+                }
+        }
+
+        if (credentialsUnwatched == true) {
+                cout << "Cannot watch for the device credentials, checking in without waiting for them" << endl;
+
+                if (provisionWaiting == true) {
+                        provisionWaiting = false;
+                        checkNow();
+                }
+        }
+
+        credentialsChanged();
+}
+
+void Updater::credentialsChanged(void) {
+        auto present = [](const std::string& file) {
+                std::error_code ec;
+
+                return (credentialIsFile(file) != true) || ((std::filesystem::file_size(file, ec) > 0) && !ec);
+        };
+        bool found = (certFile.empty() != true) && present(certFile);
+
+        if ((found == true) && (keyFile.empty() != true)) {
+                found = present(keyFile);
+        }
+
+        if ((found == false) || (isProvisioned == true)) {
+                isProvisioned = found;
+                return;
+        }
+
+        isProvisioned = true;
+        cout << "Device provisioned with " << certFile << endl;
+
+        if (provisionedHandler) {
+                provisionedHandler();
+        }
+
+        // skip the start spread, the device was waiting for this
+        if (provisionWaiting == true) {
+                provisionWaiting = false;
+                checkNow();
+        }
+}
+
+void Updater::configReloaded(void) {
+        std::string oldUri = uri, oldKey = sslkey, oldCert = sslcert;
+        std::string id;
+
+        // the whole file is already swapped in, so the server, the identify
+        // attributes and the polling settings change together between two
+        // check-ins. App data, hashing and download settings still need a
+        // restart.
+        getServerAttrs();
+        getAttrFromCfg("suricatta", "id", id);
+        controller->server(uri, sslkey, sslcert, id);
+        getIdentifyAttrs();
+        getPollAttrs();
+        watchCredentials();
+
+        metricsFile.clear();
+        getAttrFromCfg("egt_swupdate", "metrics_file", metricsFile);
+        getThrottleAttrs();
+
+        if ((uri != oldUri) || (sslkey != oldKey) || (sslcert != oldCert)) {
+                cout << "Hawkbit server settings changed, checking in with " << uri << endl;
+        }
+
+        // tell the server about the new settings right away, the session
+        // and its connections are kept
+        if (checkedIn == true) {
+                checkNow();
+        }
+
+        if (configReloadHandler) {
+                configReloadHandler();
+        }
+}
+
+void Updater::footprint(const std::string& stage) {
+        std::ifstream status("/proc/self/status");
+        std::ifstream stat("/proc/self/stat");
+        std::string line;
+        size_t rss = 0, hwm = 0;
+        unsigned long long started = 0;
+        struct timespec now;
+
+        while (std::getline(status, line)) {
+                if (line.starts_with("VmRSS:")) {
+                        std::istringstream(line.substr(6)) >> rss;
+                } else if (line.starts_with("VmHWM:")) {
+                        std::istringstream(line.substr(6)) >> hwm;
+                }
+        }
+
+        // the start time is field 22, counted after the command name
+        // which may contain spaces
+        if (std::getline(stat, line) && (line.rfind(')') != std::string::npos)) {
+                std::istringstream ss(line.substr(line.rfind(')') + 2));
+                std::string field;
+
+                for (size_t i = 3; i < 22; i++) {
+                        ss >> field;
+                }
+                ss >> started;
+        }
+
+        clock_gettime(CLOCK_BOOTTIME, &now);
+
+        double uptime = now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+        double startedMs = started * 1000.0 / sysconf(_SC_CLK_TCK);
+
+        cout << "Footprint at " << stage << ": " << (size_t) std::max(0.0, uptime - startedMs) << " ms since exec, RSS "
+             << rss << " kB, peak " << hwm << " kB" << endl;
+}
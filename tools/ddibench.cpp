@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs check-in cycles against a Hawkbit DDI server (normally the mock
+ * server) with the same controller, HTTP session and deployment fetcher the
+ * application uses, and reports latency, connections, bytes on the wire and
+ * CPU time per cycle.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <filesystem>
+#include <sys/resource.h>
+#include <curl/curl.h>
+#include <cxxopts.hpp>
+#include "http.h"
+#include "deployment.h"
+#include "controller.h"
+
+using namespace std;
+
+typedef std::chrono::steady_clock clk;
+
+// counts the C++ heap allocations of the whole process, curl and OpenSSL
+// allocate with malloc and are not included
+static std::atomic<size_t> numAllocations(0);
+
+void* operator new(size_t size) {
+	numAllocations++;
+
+	if (void *p = malloc(size ? size : 1)) {
+		return p;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+	free(p);
+}
+
+static double cpuSeconds(void) {
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static double percentile(std::vector<double> v, double p) {
+	if (v.empty()) {
+		return 0;
+	}
+
+	std::sort(v.begin(), v.end());
+
+	return v.at(std::min(v.size() - 1, (size_t) (p / 100.0 * v.size())));
+}
+
+static void report(const std::string& name, const std::vector<double>& v) {
+	cout << name << " ms: p50 " << percentile(v, 50) << ", p95 " << percentile(v, 95) << ", p99 " << percentile(v, 99)
+	     << ", max " << percentile(v, 100) << endl;
+}
+
+class Bench {
+public:
+	Bench(std::string uri, std::string id, size_t cycles, size_t intervalMs, bool download, std::string dir) :
+		multi(io), http(&multi), controller(http, uri, "", "", id), fetcher(http, dir), timer(io), cycles(cycles),
+		interval(intervalMs), download(download) {
+		// roughly what the application reports
+		controller.attribute("App Version", "2.1.0");
+		controller.attribute("SW Version", "1.0");
+		controller.attribute("HW Version", "1.0");
+		controller.attribute("serial", "0000");
+		controller.attribute("board", "sam9x60");
+		controller.attribute("App Data Hash", std::string(64, '0'));
+		controller.attribute("App Data Changed Blocks", "none");
+
+		cycle = 0;
+		failures = 0;
+		downloadSeconds = 0;
+		downloadCpu = 0;
+		downloaded = false;
+	}
+
+	void run(void) {
+		start();
+		io.run();
+	}
+
+	std::vector<double> pollMs;
+	std::vector<double> cycleMs;
+	size_t failures;
+	double downloadSeconds;
+	double downloadCpu;
+	bool downloaded;
+
+	asio::io_context io;
+	HTTPMulti multi;
+	HTTP http;
+	Controller controller;
+	DeploymentFetcher fetcher;
+
+private:
+	void start(void) {
+		auto t0 = clk::now();
+
+		controller.poll([this, t0](bool ok) {
+			pollMs.push_back(std::chrono::duration<double, std::milli>(clk::now() - t0).count());
+
+			if (ok != true) {
+				failures++;
+			}
+
+			controller.sendStatus([this, t0](bool ok) {
+				if (ok != true) {
+					failures++;
+				}
+
+				cycleMs.push_back(std::chrono::duration<double, std::milli>(clk::now() - t0).count());
+
+				if ((download == true) && (downloaded == false) && (controller.updateAvailable() == true)) {
+					fetch();
+				} else {
+					next();
+				}
+			});
+		});
+	}
+
+	void fetch(void) {
+		auto t0 = clk::now();
+		double cpu0 = cpuSeconds();
+
+		downloaded = true;
+
+		fetcher.fetch(controller.deploymentBase(), "", "", [this, t0, cpu0](bool ok) {
+			downloadSeconds = std::chrono::duration<double>(clk::now() - t0).count();
+			downloadCpu = cpuSeconds() - cpu0;
+
+			if (ok != true) {
+				cout << "Deployment download failed" << endl;
+				failures++;
+				next();
+				return;
+			}
+
+			// the next status report is the feedback for the action
+			controller.confirmInstalled();
+			controller.sendStatus([this](bool ok) {
+				next();
+			});
+		});
+	}
+
+	void next(void) {
+		if (++cycle == cycles) {
+			io.stop();
+			return;
+		}
+
+		if (interval == 0) {
+			start();
+			return;
+		}
+
+		timer.expires_after(std::chrono::milliseconds(interval));
+		timer.async_wait([this](const asio::error_code& ec) {
+			if (!ec) {
+				start();
+			}
+		});
+	}
+
+	asio::steady_timer timer;
+	size_t cycles;
+	size_t interval;
+	bool download;
+	size_t cycle;
+};
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "Benchmark the Hawkbit client against a DDI server");
+
+	options.add_options()
+	("h,help", "Show help")
+	("u,url", "Server URL", cxxopts::value<std::string>()->default_value("http://localhost:8080"))
+	("tenant", "Tenant", cxxopts::value<std::string>()->default_value("DEFAULT"))
+	("i,id", "Controller id", cxxopts::value<std::string>()->default_value("bench-1"))
+	("c,cycles", "Check-in cycles to run", cxxopts::value<size_t>()->default_value("100"))
+	("interval", "Pause between cycles in ms", cxxopts::value<size_t>()->default_value("0"))
+	("d,download", "Download the deployment if one is offered")
+	("dir", "Download directory", cxxopts::value<std::string>()->default_value("/tmp/egt-swupdate-ddibench"));
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help")) {
+		cout << options.help() << endl;
+		return 0;
+	}
+
+	std::string uri = args["url"].as<std::string>() + "/" + args["tenant"].as<std::string>() + "/controller/v1/" + args["id"].as<std::string>();
+	std::string dir = args["dir"].as<std::string>();
+	size_t cycles = std::max((size_t) 1, args["cycles"].as<size_t>());
+
+	std::error_code ec;
+	std::filesystem::remove_all(dir, ec);
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	{
+		Bench bench(uri, args["id"].as<std::string>(), cycles, args["interval"].as<size_t>(), args.count("download"), dir);
+		auto t0 = clk::now();
+		double cpu0 = cpuSeconds();
+		size_t allocs0 = numAllocations;
+
+		bench.run();
+
+		size_t allocs = numAllocations - allocs0;
+
+		double wall = std::chrono::duration<double>(clk::now() - t0).count();
+		double cpu = cpuSeconds() - cpu0 - bench.downloadCpu;
+
+		cout << std::fixed << std::setprecision(3);
+		cout << cycles << " cycles in " << wall << " s, " << bench.failures << " failures" << endl;
+		report("poll latency", bench.pollMs);
+		report("cycle latency", bench.cycleMs);
+		cout << "requests " << bench.http.requests() << ", connections " << bench.http.connects() << ", handshakes avoided "
+		     << bench.http.handshakesAvoided() << endl;
+		cout << "polls unchanged " << bench.controller.unchanged() << " (" << bench.http.notModified() << " answered 304), status uploads skipped "
+		     << bench.controller.skipped() << endl;
+		cout << "bytes sent " << bench.http.bytesSent() << ", received " << bench.http.bytesReceived() << " ("
+		     << bench.http.bytesReceived() / cycles << " per cycle, downloads included)" << endl;
+		cout << "CPU " << (cpu * 1000.0) / cycles << " ms per cycle" << endl;
+		cout << "allocations " << (double) allocs / cycles << " per cycle, response buffer " << bench.http.bufferAllocations()
+		     << " allocations, " << bench.http.bytesBuffered() << " bytes buffered ("
+		     << (double) bench.http.bytesBuffered() / std::max((size_t) 1, bench.http.requests()) << " per request)" << endl;
+
+		if (bench.downloaded) {
+			size_t bytes = 0;
+
+			for (const auto& a : bench.fetcher.artifacts()) {
+				bytes += a.size;
+			}
+
+			cout << "download " << bytes << " bytes in " << bench.downloadSeconds << " s ("
+			     << (bench.downloadSeconds > 0 ? bytes / (1024.0 * 1024.0) / bench.downloadSeconds : 0) << " MB/s), CPU "
+			     << bench.downloadCpu * 1000.0 << " ms" << endl;
+		}
+	}
+
+	curl_global_cleanup();
+
+	return 0;
+}
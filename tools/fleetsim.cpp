@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs many headless controllers in one process to put a realistic check-in
+ * load on a Hawkbit server. The controllers are spread over a few threads,
+ * each with its own event loop and curl multi handle; every controller has
+ * its own HTTP session and id and is driven by the same poll scheduler as
+ * the application, including its jitter and backoff.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <sys/resource.h>
+#include <curl/curl.h>
+#include <cxxopts.hpp>
+#include "http.h"
+#include "controller.h"
+#include "pollscheduler.h"
+
+using namespace std;
+
+typedef std::chrono::steady_clock clk;
+
+typedef struct fleetSettings_t {
+	std::string uri;
+	size_t interval;
+	size_t jitter;
+	size_t retryMin;
+	size_t retryMax;
+	bool feedback;
+} fleetSettings_t;
+
+class Shard {
+public:
+	Shard(const fleetSettings_t& settings, const std::vector<std::string>& ids) : multi(io), settings(settings) {
+		pollSettings_t poll = PollScheduler::defaults();
+
+		poll.jitter = settings.jitter;
+		poll.retryMin = settings.retryMin;
+		poll.retryMax = settings.retryMax;
+		// spread the first check-ins over one interval so the fleet
+		// does not start in lock step
+		poll.startSpread = settings.interval ? settings.interval : DEFAULT_POLL_TIME;
+
+		for (const auto& id : ids) {
+			auto http = std::make_unique<HTTP>(&multi);
+			size_t i = controllers.size();
+
+			controllers.push_back(std::make_unique<Controller>(*http, settings.uri + "/" + id, "", "", id));
+			controllers.back()->attribute("App Version", "fleetsim");
+			sessions.push_back(std::move(http));
+			schedulers.push_back(std::make_unique<PollScheduler>(io, [this, i](PollScheduler::Result done) {
+				checkIn(i, done);
+			}));
+			schedulers.back()->settings(poll);
+		}
+
+		cycles = 0;
+		failures = 0;
+		throttled = 0;
+	}
+
+	void run(std::chrono::seconds duration) {
+		asio::steady_timer stop(io);
+
+		for (auto& s : schedulers) {
+			s->start();
+		}
+
+		stop.expires_after(duration);
+		stop.async_wait([this](const asio::error_code& ec) {
+			io.stop();
+		});
+
+		io.run();
+	}
+
+	std::vector<double> latency;
+	size_t cycles;
+	size_t failures;
+	size_t throttled;
+
+	size_t requests(void) const {
+		size_t n = 0;
+		for (const auto& s : sessions) {
+			n += s->requests();
+		}
+		return n;
+	}
+
+	size_t connects(void) const {
+		size_t n = 0;
+		for (const auto& s : sessions) {
+			n += s->connects();
+		}
+		return n;
+	}
+
+	size_t bytes(void) const {
+		size_t n = 0;
+		for (const auto& s : sessions) {
+			n += s->bytesSent() + s->bytesReceived();
+		}
+		return n;
+	}
+
+private:
+	void checkIn(size_t i, PollScheduler::Result done) {
+		auto t0 = clk::now();
+		Controller& c = *controllers.at(i);
+
+		c.checkIn([this, i, t0, &c, done](bool ok) {
+			latency.push_back(std::chrono::duration<double, std::milli>(clk::now() - t0).count());
+			cycles++;
+
+			if (ok != true) {
+				failures++;
+			}
+
+			if ((c.status() == 429) || (c.status() == 503)) {
+				throttled++;
+			}
+
+			// report the offered action as installed on the next check-in
+			if ((settings.feedback == true) && (c.updateAvailable() == true)) {
+				c.confirmInstalled();
+			}
+
+			schedulers.at(i)->interval(settings.interval ? settings.interval : c.pollInterval());
+			done(ok, c.status(), c.retryAfter());
+		});
+	}
+
+	asio::io_context io;
+	HTTPMulti multi;
+	const fleetSettings_t& settings;
+	std::vector<std::unique_ptr<HTTP>> sessions;
+	std::vector<std::unique_ptr<Controller>> controllers;
+	std::vector<std::unique_ptr<PollScheduler>> schedulers;
+};
+
+static double percentile(std::vector<double>& v, double p) {
+	if (v.empty()) {
+		return 0;
+	}
+
+	return v.at(std::min(v.size() - 1, (size_t) (p / 100.0 * v.size())));
+}
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "Simulate a fleet of Hawkbit controllers");
+
+	options.add_options()
+	("h,help", "Show help")
+	("u,url", "Server URL", cxxopts::value<std::string>()->default_value("http://localhost:8080"))
+	("tenant", "Tenant", cxxopts::value<std::string>()->default_value("DEFAULT"))
+	("p,prefix", "Controller id prefix", cxxopts::value<std::string>()->default_value("fleetsim-"))
+	("n,controllers", "Number of controllers", cxxopts::value<size_t>()->default_value("1000"))
+	("t,threads", "Worker threads, 0 for one per core", cxxopts::value<size_t>()->default_value("0"))
+	("d,duration", "Run time in seconds", cxxopts::value<size_t>()->default_value("60"))
+	("i,interval", "Check-in interval in seconds, 0 to use the server's polling sleep", cxxopts::value<size_t>()->default_value("0"))
+	("j,jitter", "Random spread of the interval in percent", cxxopts::value<size_t>()->default_value("10"))
+	("retry-min", "First retry after a failed check-in in seconds", cxxopts::value<size_t>()->default_value(std::to_string(POLL_RETRY_MIN)))
+	("retry-max", "Longest retry backoff in seconds", cxxopts::value<size_t>()->default_value(std::to_string(POLL_RETRY_MAX)))
+	("f,feedback", "Answer offered deployments with success feedback");
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help")) {
+		cout << options.help() << endl;
+		return 0;
+	}
+
+	fleetSettings_t settings;
+	settings.uri = args["url"].as<std::string>() + "/" + args["tenant"].as<std::string>() + "/controller/v1";
+	settings.interval = args["interval"].as<size_t>();
+	settings.jitter = std::min((size_t) 100, args["jitter"].as<size_t>());
+	settings.retryMin = args["retry-min"].as<size_t>();
+	settings.retryMax = args["retry-max"].as<size_t>();
+	settings.feedback = args.count("feedback");
+
+	size_t count = args["controllers"].as<size_t>();
+	size_t threads = args["threads"].as<size_t>();
+	std::string prefix = args["prefix"].as<std::string>();
+
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::max((size_t) 1, std::min(threads, count));
+
+	// every controller keeps its own keep-alive connection open
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+
+		if (rl.rlim_cur < count + 64) {
+			cout << "Warning, only " << rl.rlim_cur << " file descriptors for " << count << " controllers" << endl;
+		}
+	}
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	std::vector<std::unique_ptr<Shard>> shards;
+
+	for (size_t t = 0; t < threads; t++) {
+		std::vector<std::string> ids;
+
+		for (size_t i = t; i < count; i += threads) {
+			ids.push_back(prefix + std::to_string(i));
+		}
+
+		shards.push_back(std::make_unique<Shard>(settings, ids));
+	}
+
+	auto duration = std::chrono::seconds(args["duration"].as<size_t>());
+	auto t0 = clk::now();
+	std::vector<std::thread> workers;
+
+	cout << "Running " << count << " controllers on " << threads << " threads for " << duration.count() << " s" << endl;
+
+	for (auto& shard : shards) {
+		workers.emplace_back([&shard, duration]() {
+			shard->run(duration);
+		});
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	double wall = std::chrono::duration<double>(clk::now() - t0).count();
+	std::vector<double> latency;
+	size_t cycles = 0, failures = 0, throttled = 0, requests = 0, connects = 0, bytes = 0;
+
+	for (auto& shard : shards) {
+		latency.insert(latency.end(), shard->latency.begin(), shard->latency.end());
+		cycles += shard->cycles;
+		failures += shard->failures;
+		throttled += shard->throttled;
+		requests += shard->requests();
+		connects += shard->connects();
+		bytes += shard->bytes();
+	}
+
+	std::sort(latency.begin(), latency.end());
+
+	cout << std::fixed << std::setprecision(2);
+	cout << cycles << " check-ins (" << cycles / wall << "/s), " << requests << " requests (" << requests / wall << "/s), "
+	     << failures << " failed, " << throttled << " throttled" << endl;
+	cout << "connections " << connects << ", bytes on the wire " << bytes << " (" << bytes / wall / 1024.0 << " KiB/s)" << endl;
+	cout << "check-in latency ms: p50 " << percentile(latency, 50) << ", p90 " << percentile(latency, 90) << ", p99 "
+	     << percentile(latency, 99) << ", p99.9 " << percentile(latency, 99.9) << ", max " << percentile(latency, 100) << endl;
+
+	shards.clear();
+	curl_global_cleanup();
+
+	return 0;
+}
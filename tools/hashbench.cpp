@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cxxopts.hpp>
+#include "hash.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "Measure app data hashing throughput");
+
+	options.add_options()
+	("h,help", "Show help")
+	("f,file", "File to hash", cxxopts::value<std::string>()->default_value("/opt/data/app_data.img"))
+	("b,block-size", "Read/tree block size in bytes", cxxopts::value<size_t>()->default_value(std::to_string(HASH_BLOCK_SIZE)))
+	("t,threads", "Worker threads for tree mode, 0 for one per core", cxxopts::value<size_t>()->default_value("0"))
+	("r,runs", "Runs per mode", cxxopts::value<size_t>()->default_value("3"));
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help")) {
+		cout << options.help() << endl;
+		return 0;
+	}
+
+	std::string file = args["file"].as<std::string>();
+	size_t runs = args["runs"].as<size_t>();
+
+	cout << std::fixed << std::setprecision(2);
+
+	for (hashMode_t mode : {HASH_FLAT, HASH_TREE}) {
+		HashEngine engine(mode, args["block-size"].as<size_t>(), args["threads"].as<size_t>());
+		double best = 0;
+		std::string digest;
+
+		for (size_t i = 0; i < runs; i++) {
+			if (engine.hashFile(file, digest) != true) {
+				return 1;
+			}
+
+			cout << HashEngine::modeName(mode) << " run " << i + 1 << ": " << engine.seconds() << " s, "
+			     << engine.throughput() << " MB/s" << endl;
+
+			best = std::max(best, engine.throughput());
+		}
+
+		cout << HashEngine::modeName(mode) << ": " << engine.bytes() << " bytes, " << engine.blockSize() << " byte blocks, "
+		     << ((mode == HASH_TREE) ? engine.threads() : 1) << " thread(s), best " << best << " MB/s, digest " << digest << endl;
+	}
+
+	return 0;
+}
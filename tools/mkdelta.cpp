@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <strings.h>
+#include <unistd.h>
+#include <cxxopts.hpp>
+#include "delta.h"
+#include "hash.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "Build an app data delta between two images");
+
+	options.add_options()
+	("h,help", "Show help")
+	("s,source", "Image currently on the devices", cxxopts::value<std::string>())
+	("t,target", "New image", cxxopts::value<std::string>())
+	("o,output", "Delta file to write", cxxopts::value<std::string>())
+	("b,block-size", "Match block size in bytes", cxxopts::value<size_t>()->default_value(std::to_string(DELTA_BLOCK_SIZE)))
+	("c,check", "Apply the delta to a scratch file and verify the result");
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help") || !args.count("source") || !args.count("target")) {
+		cout << options.help() << endl;
+		return args.count("help") ? 0 : 1;
+	}
+
+	std::string source = args["source"].as<std::string>();
+	std::string target = args["target"].as<std::string>();
+	std::string output = args.count("output") ? args["output"].as<std::string>() : target + DELTA_SUFFIX;
+
+	DeltaBuilder builder(args["block-size"].as<size_t>());
+
+	if (builder.build(source, target, output) != true) {
+		return 1;
+	}
+
+	size_t targetSize = builder.copied() + builder.literal();
+
+	cout << std::fixed << std::setprecision(2);
+	cout << "Target: " << targetSize << " bytes, " << builder.copied() << " copied, " << builder.literal() << " literal" << endl;
+	cout << "Delta: " << builder.deltaSize() << " bytes, "
+	     << (targetSize ? (100.0 * builder.deltaSize()) / targetSize : 0) << "% of the full image" << endl;
+
+	if (args.count("check")) {
+		DeltaPatcher patcher;
+		HashEngine engine(HASH_FLAT);
+		std::string scratch = output + ".check";
+		std::string digest;
+
+		bool ok = (patcher.apply(output, source, scratch, builder.sourceSha256()) == true) && (engine.hashFile(scratch, digest) == true) &&
+			  (strcasecmp(digest.c_str(), patcher.targetSha256().c_str()) == 0);
+
+		unlink(scratch.c_str());
+
+		if (ok != true) {
+			cout << "Check failed, the delta does not rebuild the target" << endl;
+			return 1;
+		}
+
+		cout << "Check passed, " << digest << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * A minimal Hawkbit DDI server for offline testing. It speaks plain HTTP/1.1
+ * with keep-alive, answers the controller base poll, configData, the
+ * deploymentBase of a single action, its feedback and the artifact download
+ * (with Range support), and can add latency, limit bandwidth and inject
+ * errors and dropped connections.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/evp.h>
+#include <cxxopts.hpp>
+
+using namespace std;
+
+#define ACTION_ID 1
+#define ARTIFACT_NAME "app_data.img"
+
+typedef struct request_t {
+	std::string method;
+	std::string path;
+	std::string host;
+	std::map<std::string, std::string> headers;
+	std::string body;
+} request_t;
+
+typedef struct settings_t {
+	std::string tenant;
+	std::string sleep;
+	std::string artifactName;
+	std::string unpackedSha256;
+	size_t unpackedSize;
+	size_t latencyMs;
+	size_t bandwidth;
+	size_t errorRate;
+	size_t dropRate;
+	bool deployment;
+	bool etag;
+	bool verbose;
+} settings_t;
+
+static settings_t settings;
+static std::vector<char> artifact;
+static std::string artifactSha256;
+static std::mutex finishedLock;
+static std::set<std::string> finished;
+static std::set<std::string> configured;
+static std::atomic<size_t> numRequests(0);
+static std::atomic<size_t> numConnections(0);
+static std::atomic<size_t> numErrors(0);
+static std::atomic<size_t> numDropped(0);
+static std::atomic<size_t> numNotModified(0);
+static std::atomic<size_t> numSent(0);
+static volatile sig_atomic_t stop = 0;
+
+static bool chance(size_t percent) {
+	thread_local std::mt19937 rng(std::random_device{}());
+
+	return (percent > 0) && (std::uniform_int_distribution<size_t>(0, 99)(rng) < percent);
+}
+
+static bool sendAll(int fd, const char *data, size_t size, bool throttle) {
+	// send in 100 ms slices to approximate the configured bandwidth
+	size_t slice = (throttle && settings.bandwidth) ? std::max((size_t) 1, settings.bandwidth / 10) : size;
+
+	while (size > 0) {
+		auto start = std::chrono::steady_clock::now();
+		size_t len = std::min(slice, size);
+
+		while (len > 0) {
+			ssize_t ret = send(fd, data, len, MSG_NOSIGNAL);
+
+			if (ret < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+
+			data += ret;
+			size -= ret;
+			len -= ret;
+			numSent += ret;
+		}
+
+		if (throttle && settings.bandwidth && (size > 0)) {
+			std::this_thread::sleep_until(start + std::chrono::milliseconds(100));
+		}
+	}
+
+	return true;
+}
+
+static bool readRequest(int fd, std::string& buf, request_t& req) {
+	size_t end;
+
+	while ((end = buf.find("\r\n\r\n")) == std::string::npos) {
+		char tmp[4096];
+		ssize_t ret = recv(fd, tmp, sizeof(tmp), 0);
+
+		if (ret <= 0) {
+			return false;
+		}
+
+		buf.append(tmp, ret);
+	}
+
+	std::istringstream head(buf.substr(0, end));
+	std::string line, version;
+
+	std::getline(head, line);
+	std::istringstream(line) >> req.method >> req.path >> version;
+	req.headers.clear();
+
+	while (std::getline(head, line)) {
+		size_t colon = line.find(':');
+
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		if (colon != std::string::npos) {
+			std::string key = line.substr(0, colon);
+			std::string value = line.substr(colon + 1);
+
+			std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+			value.erase(0, value.find_first_not_of(' '));
+			req.headers[key] = value;
+		}
+	}
+
+	buf.erase(0, end + 4);
+
+	req.host = req.headers["host"];
+
+	size_t length = req.headers.count("content-length") ? std::stoul(req.headers["content-length"]) : 0;
+
+	if (req.headers["expect"] == "100-continue") {
+		std::string cont("HTTP/1.1 100 Continue\r\n\r\n");
+		sendAll(fd, cont.data(), cont.size(), false);
+	}
+
+	while (buf.size() < length) {
+		char tmp[4096];
+		ssize_t ret = recv(fd, tmp, sizeof(tmp), 0);
+
+		if (ret <= 0) {
+			return false;
+		}
+
+		buf.append(tmp, ret);
+	}
+
+	req.body = buf.substr(0, length);
+	buf.erase(0, length);
+
+	return true;
+}
+
+static bool respond(int fd, int status, const std::string& reason, const std::string& type, const char *body, size_t size,
+		    const std::string& extra = "") {
+	std::stringstream head;
+
+	head << "HTTP/1.1 " << status << " " << reason << "\r\n"
+	     << "Content-Length: " << size << "\r\n"
+	     << (type.empty() ? "" : "Content-Type: " + type + "\r\n")
+	     << extra
+	     << "\r\n";
+
+	std::string h = head.str();
+
+	if (sendAll(fd, h.data(), h.size(), false) != true) {
+		return false;
+	}
+
+	if ((size > 0) && chance(settings.dropRate)) {
+		// hang up half way through the body
+		numDropped++;
+		sendAll(fd, body, size / 2, true);
+		return false;
+	}
+
+	return sendAll(fd, body, size, true);
+}
+
+static bool respondJson(int fd, const std::string& json) {
+	return respond(fd, 200, "OK", "application/hal+json;charset=UTF-8", json.data(), json.size());
+}
+
+static std::vector<std::string> split(const std::string& path) {
+	std::vector<std::string> parts;
+	std::string p = path.substr(0, path.find('?'));
+	std::istringstream ss(p);
+	std::string part;
+
+	while (std::getline(ss, part, '/')) {
+		if (!part.empty()) {
+			parts.push_back(part);
+		}
+	}
+
+	return parts;
+}
+
+static bool handle(int fd, const request_t& req) {
+	std::vector<std::string> parts = split(req.path);
+
+	numRequests++;
+
+	if (settings.verbose) {
+		cout << req.method << " " << req.path << " (" << req.body.size() << " bytes)" << endl;
+	}
+
+	if (settings.latencyMs) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(settings.latencyMs));
+	}
+
+	if (chance(settings.errorRate)) {
+		std::string body("{\"message\":\"injected error\"}");
+		numErrors++;
+		return respond(fd, 503, "Service Unavailable", "application/json", body.data(), body.size(), "Retry-After: 1\r\n");
+	}
+
+	// /<tenant>/controller/v1/<id>[/...]
+	if ((parts.size() < 4) || (parts[0] != settings.tenant) || (parts[1] != "controller") || (parts[2] != "v1")) {
+		return respond(fd, 404, "Not Found", "", NULL, 0);
+	}
+
+	std::string id = parts[3];
+	std::string base = "http://" + req.host + "/" + settings.tenant + "/controller/v1/" + id;
+	bool open, wantsConfig;
+
+	{
+		std::lock_guard<std::mutex> guard(finishedLock);
+		open = settings.deployment && (finished.count(id) == 0);
+		wantsConfig = (configured.count(id) == 0);
+	}
+
+	if ((parts.size() == 4) && (req.method == "GET")) {
+		std::stringstream json;
+		std::vector<std::string> links;
+
+		// like hawkBit, configData is only linked until the attributes are sent
+		if (open) {
+			links.push_back("\"deploymentBase\":{\"href\":\"" + base + "/deploymentBase/" + std::to_string(ACTION_ID) + "?c=-2129030598\"}");
+		}
+		if (wantsConfig) {
+			links.push_back("\"configData\":{\"href\":\"" + base + "/configData\"}");
+		}
+
+		json << "{\"config\":{\"polling\":{\"sleep\":\"" << settings.sleep << "\"}},\"_links\":{";
+		for (size_t i = 0; i < links.size(); i++) {
+			json << (i ? "," : "") << links.at(i);
+		}
+		json << "}}";
+
+		if (settings.etag != true) {
+			return respondJson(fd, json.str());
+		}
+
+		std::stringstream tag;
+		tag << "\"" << std::hex << std::hash<std::string>()(json.str()) << "\"";
+
+		auto match = req.headers.find("if-none-match");
+
+		if ((match != req.headers.end()) && (match->second == tag.str())) {
+			numNotModified++;
+			return respond(fd, 304, "Not Modified", "", NULL, 0, "ETag: " + tag.str() + "\r\n");
+		}
+
+		std::string body = json.str();
+
+		return respond(fd, 200, "OK", "application/hal+json;charset=UTF-8", body.data(), body.size(), "ETag: " + tag.str() + "\r\n");
+	}
+
+	if ((parts.size() == 5) && (parts[4] == "configData") && (req.method == "PUT")) {
+		std::lock_guard<std::mutex> guard(finishedLock);
+		configured.insert(id);
+		return respond(fd, 200, "OK", "", NULL, 0);
+	}
+
+	if ((parts.size() == 6) && (parts[4] == "deploymentBase") && (req.method == "GET")) {
+		std::stringstream json, metadata;
+
+		// what a compressed artifact unpacks to, as hawkbit software
+		// module metadata
+		if (settings.unpackedSha256.empty() != true) {
+			metadata << "{\"key\":\"" << settings.artifactName << ".unpacked_sha256\",\"value\":\"" << settings.unpackedSha256 << "\"}";
+		}
+		if (settings.unpackedSize > 0) {
+			metadata << (metadata.tellp() > 0 ? "," : "") << "{\"key\":\"" << settings.artifactName << ".unpacked_size\",\"value\":\""
+				 << settings.unpackedSize << "\"}";
+		}
+
+		json << "{\"id\":\"" << ACTION_ID << "\",\"deployment\":{\"download\":\"forced\",\"update\":\"forced\",\"chunks\":[{"
+		     << "\"part\":\"os\",\"version\":\"1.0\",\"name\":\"app\",\"metadata\":[" << metadata.str() << "],"
+		     << "\"artifacts\":[{\"filename\":\"" << settings.artifactName << "\","
+		     << "\"hashes\":{\"sha256\":\"" << artifactSha256 << "\"},\"size\":" << artifact.size() << ","
+		     << "\"_links\":{\"download-http\":{\"href\":\"" << base << "/softwaremodules/1/artifacts/" << settings.artifactName << "\"}}}]}]}}";
+
+		return respondJson(fd, json.str());
+	}
+
+	if ((parts.size() == 7) && (parts[4] == "deploymentBase") && (parts[6] == "feedback") && (req.method == "POST")) {
+		std::lock_guard<std::mutex> guard(finishedLock);
+		finished.insert(id);
+		return respond(fd, 200, "OK", "", NULL, 0);
+	}
+
+	if ((parts.size() == 8) && (parts[4] == "softwaremodules") && (parts[6] == "artifacts") && (req.method == "GET")) {
+		size_t offset = 0;
+		auto range = req.headers.find("range");
+
+		if ((range != req.headers.end()) && range->second.starts_with("bytes=")) {
+			offset = std::stoul(range->second.substr(6));
+
+			if (offset >= artifact.size()) {
+				return respond(fd, 416, "Range Not Satisfiable", "", NULL, 0);
+			}
+
+			std::string extra = "Content-Range: bytes " + std::to_string(offset) + "-" + std::to_string(artifact.size() - 1) + "/" +
+					    std::to_string(artifact.size()) + "\r\n";
+
+			return respond(fd, 206, "Partial Content", "application/octet-stream", artifact.data() + offset,
+				       artifact.size() - offset, extra);
+		}
+
+		return respond(fd, 200, "OK", "application/octet-stream", artifact.data(), artifact.size());
+	}
+
+	return respond(fd, 404, "Not Found", "", NULL, 0);
+}
+
+static void serve(int fd) {
+	std::string buf;
+	request_t req;
+	int one = 1;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	while ((stop == 0) && readRequest(fd, buf, req) && handle(fd, req)) {
+		if (req.headers["connection"] == "close") {
+			break;
+		}
+	}
+
+	close(fd);
+}
+
+static void onSignal(int sig) {
+	stop = 1;
+}
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "Mock Hawkbit DDI server");
+
+	options.add_options()
+	("h,help", "Show help")
+	("p,port", "TCP port to listen on", cxxopts::value<uint16_t>()->default_value("8080"))
+	("tenant", "Tenant in the controller URLs", cxxopts::value<std::string>()->default_value("DEFAULT"))
+	("sleep", "Polling interval handed to the controllers", cxxopts::value<std::string>()->default_value("00:05:00"))
+	("d,deployment", "Offer a deployment until a controller sends feedback")
+	("artifact-size", "Size of the generated artifact in bytes", cxxopts::value<size_t>()->default_value("1048576"))
+	("artifact-name", "File name of the artifact, end it in .rootfs for a slot install", cxxopts::value<std::string>()->default_value(ARTIFACT_NAME))
+	("artifact-file", "Serve this file instead of generated data, e.g. a sample from egt-swupdate-unpackbench", cxxopts::value<std::string>())
+	("unpacked-sha256", "Digest of the unpacked artifact, sent as chunk metadata", cxxopts::value<std::string>()->default_value(""))
+	("unpacked-size", "Size of the unpacked artifact, sent as chunk metadata", cxxopts::value<size_t>()->default_value("0"))
+	("l,latency", "Delay before every response in ms", cxxopts::value<size_t>()->default_value("0"))
+	("b,bandwidth", "Bandwidth per connection in bytes/s, 0 for unlimited", cxxopts::value<size_t>()->default_value("0"))
+	("e,error-rate", "Percentage of requests answered with 503", cxxopts::value<size_t>()->default_value("0"))
+	("drop-rate", "Percentage of responses cut off half way", cxxopts::value<size_t>()->default_value("0"))
+	("e,etag", "Send ETags with polls and answer If-None-Match with 304")
+	("v,verbose", "Log every request");
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help")) {
+		cout << options.help() << endl;
+		return 0;
+	}
+
+	settings.tenant = args["tenant"].as<std::string>();
+	settings.sleep = args["sleep"].as<std::string>();
+	settings.artifactName = args["artifact-name"].as<std::string>();
+	settings.unpackedSha256 = args["unpacked-sha256"].as<std::string>();
+	settings.unpackedSize = args["unpacked-size"].as<size_t>();
+	settings.latencyMs = args["latency"].as<size_t>();
+	settings.bandwidth = args["bandwidth"].as<size_t>();
+	settings.errorRate = args["error-rate"].as<size_t>();
+	settings.dropRate = args["drop-rate"].as<size_t>();
+	settings.deployment = args.count("deployment");
+	settings.etag = args.count("etag");
+	settings.verbose = args.count("verbose");
+
+	if (args.count("artifact-file")) {
+		std::ifstream in(args["artifact-file"].as<std::string>(), std::ios::binary);
+
+		if (in.is_open() != true) {
+			cout << "Cannot read " << args["artifact-file"].as<std::string>() << endl;
+			return 1;
+		}
+		artifact.assign(std::istreambuf_iterator<char>(in), {});
+	} else {
+		// the artifact is the same on every run so digests can be compared
+		std::mt19937 gen(42);
+		artifact.resize(args["artifact-size"].as<size_t>());
+		for (auto& c : artifact) {
+			c = (char) gen();
+		}
+	}
+
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int mdLen;
+	std::stringstream hex;
+
+	EVP_Digest(artifact.data(), artifact.size(), md, &mdLen, EVP_sha256(), NULL);
+	hex << std::hex << std::setfill('0');
+	for (unsigned int i = 0; i < mdLen; i++) {
+		hex << std::setw(2) << (int) md[i];
+	}
+	artifactSha256 = hex.str();
+
+	int sock = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int one = 1;
+	struct sockaddr_in6 addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(args["port"].as<uint16_t>());
+
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if ((sock < 0) || (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(sock, 1024) != 0)) {
+		cout << "Error listening on port " << args["port"].as<uint16_t>() << ": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	cout << "Serving tenant " << settings.tenant << " on port " << args["port"].as<uint16_t>() << ", artifact "
+	     << artifact.size() << " bytes, sha256 " << artifactSha256 << endl;
+
+	while (stop == 0) {
+		int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+
+		if (fd < 0) {
+			continue;
+		}
+
+		numConnections++;
+		std::thread(serve, fd).detach();
+	}
+
+	close(sock);
+
+	cout << numConnections << " connections, " << numRequests << " requests, " << numErrors << " errors injected, "
+	     << numDropped << " responses dropped, " << numNotModified << " not modified, " << numSent << " bytes sent" << endl;
+
+	return 0;
+}
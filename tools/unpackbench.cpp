@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2024 Microchip Technology Inc.  All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Measures how fast compressed artifacts are unpacked and hashed while they
+ * stream in, the way the deployment download does it. Without --file a
+ * sample image that compresses like a root file system (text, binaries and
+ * free space) is generated and packed with zstd and xz; --out keeps the
+ * samples so they can be served with egt-swupdate-mockddi --artifact-file.
+ *
+ * With --slot every sample is also installed through the slot writer. The
+ * data is handed over without waiting for the writer, like the last chunks of
+ * a transfer curl completes after the writer paused it, so the install ends
+ * with data held back that has to make it into the slot.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <ctime>
+#include <cxxopts.hpp>
+#include <zstd.h>
+#include <lzma.h>
+#include <openssl/evp.h>
+#include "decompress.h"
+#include "installer.h"
+#include "hash.h"
+
+using namespace std;
+
+// stands in for the sink storing the artifact, it only hashes
+class HashSink : public HTTPSink {
+public:
+	HashSink() { ctx = EVP_MD_CTX_new(); EVP_DigestInit_ex(ctx, EVP_sha256(), NULL); }
+	~HashSink() { EVP_MD_CTX_free(ctx); }
+
+	bool write(const char *data, size_t size) override {
+		return EVP_DigestUpdate(ctx, data, size) == 1;
+	}
+
+	std::string digest(void) {
+		unsigned char md[EVP_MAX_MD_SIZE];
+		unsigned int len = 0;
+
+		EVP_DigestFinal_ex(ctx, md, &len);
+		EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+
+		return HashEngine::toHex(md, len);
+	}
+
+private:
+	EVP_MD_CTX *ctx;
+};
+
+typedef struct sample_t {
+	std::string name;
+	compression_t type;
+	std::string data;
+} sample_t;
+
+static std::string sha256(const std::string& data) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int len = 0;
+
+	EVP_Digest(data.data(), data.size(), md, &len, EVP_sha256(), NULL);
+
+	return HashEngine::toHex(md, len);
+}
+
+// returns the digest of what ended up in the slot, empty on failure
+static std::string install(const std::string& slot, const sample_t& s, size_t size, size_t chunk, Decompressor& unpack) {
+	asio::io_context io;
+	SlotWriter writer(io);
+	bool paused = false, ok;
+	std::string packed, digest;
+
+	ok = writer.open(slot, size, [&paused](bool pause) { paused = pause; }) && unpack.open(s.type, &writer);
+
+	for (size_t off = 0; ok && (off < s.data.size()); off += chunk) {
+		ok = unpack.write(s.data.data() + off, std::min(chunk, s.data.size() - off));
+	}
+
+	// the order the deployment finishes in: decoder, held back data, writer
+	ok = ok && unpack.finish(packed);
+	cout << s.name << ": writer " << (paused ? "paused" : "not paused") << " at the end of the transfer, ";
+	ok = ok && writer.flush();
+
+	if (ok != true) {
+		unpack.close();
+		writer.abort();
+		cout << "install failed" << endl;
+		return "";
+	}
+
+	// the writer thread posts the result, keep the loop waiting for it
+	auto work = asio::make_work_guard(io);
+
+	writer.finish([&](bool installed, std::string d) {
+		digest = installed ? d : "";
+		work.reset();
+	});
+
+	io.run();
+
+	cout << writer.written() << " bytes installed, writer fell behind " << writer.stalls() << " times" << endl;
+
+	return digest;
+}
+
+static double cpuSeconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 40% text, 40% free space and 20% already compressed data, which packs
+// about 3-4x like our images
+static std::string makeImage(size_t size) {
+	static const char *words[] = {"lib", "usr", "share", "config", "egt", "widget", "return", "static", "const",
+				      "include", "status", "update", "0x00000000", "error", "device", "kernel", "=", ";", "{", "}"};
+	std::mt19937_64 rng(42);
+	std::string image;
+
+	image.reserve(size);
+
+	while (image.size() < size) {
+		size_t block = std::min((size_t) 64 * 1024, size - image.size());
+		size_t kind = rng() % 10;
+
+		if (kind < 4) {
+			std::string text;
+
+			while (text.size() < block) {
+				text += words[rng() % (sizeof(words) / sizeof(words[0]))];
+				text += (rng() % 8) ? ' ' : '\n';
+			}
+			image.append(text, 0, block);
+		} else if (kind < 8) {
+			image.append(block, '\0');
+		} else {
+			for (size_t i = 0; i < block; i++) {
+				image.push_back((char) rng());
+			}
+		}
+	}
+
+	return image;
+}
+
+static bool packZstd(const std::string& in, int level, std::string& out) {
+	ZSTD_CCtx *cctx = ZSTD_createCCtx();
+
+	out.resize(ZSTD_compressBound(in.size()));
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, std::thread::hardware_concurrency());
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+
+	size_t ret = ZSTD_compress2(cctx, out.data(), out.size(), in.data(), in.size());
+	ZSTD_freeCCtx(cctx);
+
+	if (ZSTD_isError(ret)) {
+		cout << "zstd: " << ZSTD_getErrorName(ret) << endl;
+		return false;
+	}
+
+	out.resize(ret);
+
+	return true;
+}
+
+// blockSize 0 for a single block stream, which can only be unpacked by one
+// thread; xz -T makes blocks
+static bool packXz(const std::string& in, uint32_t preset, uint64_t blockSize, std::string& out) {
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_ret ret;
+
+	if (blockSize > 0) {
+		lzma_mt mt = {};
+
+		mt.threads = std::max(1u, std::thread::hardware_concurrency());
+		mt.block_size = blockSize;
+		mt.preset = preset;
+		mt.check = LZMA_CHECK_CRC64;
+		ret = lzma_stream_encoder_mt(&strm, &mt);
+	} else {
+		ret = lzma_easy_encoder(&strm, preset, LZMA_CHECK_CRC64);
+	}
+
+	if (ret != LZMA_OK) {
+		cout << "xz: encoder error " << ret << endl;
+		return false;
+	}
+
+	out.resize(lzma_stream_buffer_bound(in.size()));
+	strm.next_in = (const uint8_t*) in.data();
+	strm.avail_in = in.size();
+	strm.next_out = (uint8_t*) out.data();
+	strm.avail_out = out.size();
+
+	ret = lzma_code(&strm, LZMA_FINISH);
+	out.resize(out.size() - strm.avail_out);
+	lzma_end(&strm);
+
+	if (ret != LZMA_STREAM_END) {
+		cout << "xz: error " << ret << endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv) {
+	cxxopts::Options options(argv[0], "Measure streaming decompression throughput of compressed artifacts");
+
+	options.add_options()
+	("h,help", "Show help")
+	("f,file", "Compressed artifact (.zst or .xz) instead of the generated samples", cxxopts::value<std::string>())
+	("s,size", "Size of the generated sample image in MiB", cxxopts::value<size_t>()->default_value("32"))
+	("o,out", "Directory to keep the generated samples in", cxxopts::value<std::string>())
+	("w,window", "Largest window accepted in MiB", cxxopts::value<size_t>()->default_value(std::to_string(DECOMPRESS_WINDOW_MB)))
+	("t,threads", "xz decoder threads, 0 for one less than there are cores", cxxopts::value<size_t>()->default_value("0"))
+	("c,chunk", "Bytes handed over per receive callback", cxxopts::value<size_t>()->default_value("16384"))
+	("r,runs", "Runs per sample", cxxopts::value<size_t>()->default_value("3"))
+	("slot", "File to install every sample into through the slot writer", cxxopts::value<std::string>());
+
+	auto args = options.parse(argc, argv);
+	if (args.count("help")) {
+		cout << options.help() << endl;
+		return 0;
+	}
+
+	std::vector<sample_t> samples;
+	std::string expected;
+	size_t size = 0;
+
+	if (args.count("file")) {
+		std::string file = args["file"].as<std::string>();
+		std::ifstream in(file, std::ios::binary);
+		sample_t s = {file, Decompressor::detect(file), std::string(std::istreambuf_iterator<char>(in), {})};
+
+		if ((in.is_open() != true) || (s.type == COMPRESSION_NONE)) {
+			cout << "Cannot read a .zst or .xz artifact from " << file << endl;
+			return 1;
+		}
+		samples.push_back(std::move(s));
+	} else {
+		std::string image = makeImage(args["size"].as<size_t>() * 1024 * 1024);
+		std::string packed;
+
+		expected = sha256(image);
+		size = image.size();
+
+		if (packZstd(image, 3, packed)) {
+			samples.push_back({"sample.rootfs.zst (level 3)", COMPRESSION_ZSTD, packed});
+		}
+		if (packZstd(image, 19, packed)) {
+			samples.push_back({"sample.rootfs.zst (level 19)", COMPRESSION_ZSTD, packed});
+		}
+		if (packXz(image, 6, 0, packed)) {
+			samples.push_back({"sample.rootfs.xz (-6)", COMPRESSION_XZ, packed});
+		}
+		if (packXz(image, 6, 4 * 1024 * 1024, packed)) {
+			samples.push_back({"sample.rootfs.xz (-6 -T, 4 MiB blocks)", COMPRESSION_XZ, packed});
+		}
+
+		if (args.count("out")) {
+			std::string dir = args["out"].as<std::string>();
+			const char *names[] = {"sample.rootfs.zst", "sample-19.rootfs.zst", "sample.rootfs.xz", "sample-mt.rootfs.xz"};
+
+			std::ofstream(dir + "/sample.rootfs", std::ios::binary) << image;
+			for (size_t i = 0; i < samples.size(); i++) {
+				std::ofstream(dir + "/" + names[i], std::ios::binary) << samples[i].data;
+			}
+			cout << "Samples written to " << dir << ", unpacked sha256 " << expected << ", size " << image.size() << endl;
+		}
+	}
+
+	size_t chunk = std::max(args["chunk"].as<size_t>(), (size_t) 1);
+	size_t runs = args["runs"].as<size_t>();
+	Decompressor unpack;
+	HashSink sink;
+
+	unpack.limits(args["window"].as<size_t>(), args["threads"].as<size_t>());
+
+	cout << std::fixed << std::setprecision(1);
+
+	for (const auto& s : samples) {
+		double bestIn = 0, bestOut = 0, cpu = 0;
+		size_t memory = 0, out = 0;
+		bool ok = true;
+		std::string digest, packed;
+
+		for (size_t r = 0; (r < runs) && ok; r++) {
+			auto t0 = std::chrono::steady_clock::now();
+			double c0 = cpuSeconds();
+
+			ok = unpack.open(s.type, &sink);
+
+			for (size_t off = 0; ok && (off < s.data.size()); off += chunk) {
+				ok = unpack.write(s.data.data() + off, std::min(chunk, s.data.size() - off));
+				memory = std::max(memory, unpack.memory());
+			}
+
+			out = unpack.out();
+			ok = ok && unpack.finish(packed);
+			digest = sink.digest();
+
+			double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+			bestIn = std::max(bestIn, s.data.size() / secs / (1024 * 1024));
+			bestOut = std::max(bestOut, out / secs / (1024 * 1024));
+			cpu = (cpuSeconds() - c0) / secs;
+		}
+
+		if (ok != true) {
+			cout << s.name << ": failed" << endl;
+			continue;
+		}
+
+		cout << s.name << ": " << s.data.size() << " -> " << out << " bytes (" << (double) out / s.data.size() << "x), best "
+		     << bestIn << " MB/s in, " << bestOut << " MB/s out, " << cpu << " cores busy, decoder " << memory / 1024 << " KiB" << endl;
+
+		if ((expected.empty() != true) && (digest != expected)) {
+			cout << s.name << ": unpacked digest " << digest << " does not match " << expected << endl;
+			return 1;
+		}
+	}
+
+	if (args.count("slot")) {
+		std::string slot = args["slot"].as<std::string>();
+
+		// the slot writer only opens what exists
+		std::ofstream(slot, std::ios::app).close();
+
+		for (const auto& s : samples) {
+			std::string digest = install(slot, s, size, chunk, unpack);
+
+			if (digest.empty() || ((expected.empty() != true) && (digest != expected))) {
+				cout << s.name << ": slot " << (digest.empty() ? "install failed" : "holds " + digest + " instead of " + expected) << endl;
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}